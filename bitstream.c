@@ -23,24 +23,25 @@
  */
 
 #include "bitstream.h"
-constexpr uint8_t cBitstream::m_bitMask[];
+
+#include <endian.h>
+#include <string.h>
 
 cBitstream::cBitstream(uint8_t *data, unsigned int bits)
 {
-  m_data   = data;
-  m_offset = 0;
-  m_len    = bits;
-  m_error  = false;
-  m_doEP3  = false;
+  setBitstream(data, bits);
 }
 
 void cBitstream::setBitstream(uint8_t *data, unsigned int bits)
 {
-  m_data   = data;
-  m_offset = 0;
-  m_len    = bits;
-  m_error  = false;
-  m_doEP3  = false;
+  m_data      = data;
+  m_pos       = 0;
+  m_end       = (bits + 7) / 8;
+  m_len       = bits;
+  m_cache     = 0;
+  m_cacheBits = 0;
+  m_error     = false;
+  m_doEP3     = false;
 }
 
 // this is a bitstream that has embedded emulation_prevention_three_byte
@@ -49,103 +50,125 @@ void cBitstream::setBitstream(uint8_t *data, unsigned int bits)
 
 cBitstream::cBitstream(uint8_t *data, unsigned int bits, bool doEP3)
 {
-  m_data   = data;
-  m_offset = 16; // skip header and use as sentinel for EP3 detection
-  m_len    = bits;
-  m_error  = false;
-  m_doEP3  = true;
+  setBitstream(data, bits);
+  m_pos   = 2; // skip header and use as sentinel for EP3 detection
+  m_doEP3 = true;
 }
 
-void cBitstream::skipBits(unsigned int num)
+// fills the cache up, EP3 bytes are dropped on the way
+void cBitstream::refill()
 {
-  register unsigned int tmp;
-
-  if (!m_doEP3)
+  // a whole word at once unless there may be an EP3 byte in it
+  if (m_cacheBits <= 56 && m_pos + 8 <= m_len / 8)
   {
-    m_offset += num;
-    return;
+    uint64_t word;
+    memcpy(&word, m_data + m_pos, sizeof(word));
+    word = be64toh(word);
+    uint64_t threes = word ^ 0x0303030303030303ULL;
+    if (!m_doEP3 || !((threes - 0x0101010101010101ULL) & ~threes & 0x8080808080808080ULL))
+    {
+      unsigned int bytes = (64 - m_cacheBits) / 8;
+      m_cache |= (word >> (64 - bytes * 8)) << (64 - m_cacheBits - bytes * 8);
+      m_cacheBits += bytes * 8;
+      m_pos += bytes;
+      return;
+    }
   }
 
-  while (num)
-  { 
-    tmp = m_offset >> 3;
-    if (!(m_offset & 7) && (m_data[tmp--] == 3) && (m_data[tmp--] == 0) && (m_data[tmp] == 0))
-      m_offset += 8;   // skip EP3 byte
-    
-    if (!(m_offset & 7) && (num >= 8)) // byte boundary, speed up things a little bit
-    { 
-      m_offset += 8;
-      num -= 8;
-    }
-    else if ((tmp = 8-(m_offset & 7)) <= num) // jump to byte boundary
+  while (m_cacheBits <= 56 && m_pos < m_end)
+  {
+    uint8_t byte = m_data[m_pos];
+    if (m_doEP3 && byte == 3 && m_data[m_pos-1] == 0 && m_data[m_pos-2] == 0)
     {
-     m_offset += tmp;
-     num -= tmp;
+      m_pos++;
+      continue;
     }
-    else
-    { 
-      m_offset += num;
-      num = 0;
-    }
-    
-    if (m_offset >= m_len)
-    { 
-      m_error = true;
-      break;
+
+    unsigned int bits = 8;
+    if (m_len - m_pos * 8 < 8)
+    {
+      bits = m_len - m_pos * 8;
+      byte >>= 8 - bits;
     }
+    m_cache |= (uint64_t)byte << (64 - m_cacheBits - bits);
+    m_cacheBits += bits;
+    m_pos++;
   }
 }
 
-unsigned int cBitstream::readBits(unsigned int num)
+void cBitstream::consume(unsigned int num)
 {
-  unsigned int r = 0;
+  m_cache = num < 64 ? m_cache << num : 0;
+  m_cacheBits -= num;
+}
 
-  while (num)
+void cBitstream::skipBits(unsigned int num)
+{
+  while (num > m_cacheBits)
   {
-    if (m_doEP3)
+    num -= m_cacheBits;
+    consume(m_cacheBits);
+    refill();
+    if (!m_cacheBits)
     {
-      register unsigned int tmp = m_offset >> 3;
-      if (!(m_offset & 7) && (m_data[tmp--] == 3) && (m_data[tmp--] == 0) && (m_data[tmp] == 0))
-        m_offset += 8;   // skip EP3 byte
+      m_error = true;
+      return;
     }
+  }
+  consume(num);
+}
 
-    if (m_offset >= m_len)
+unsigned int cBitstream::readBits(unsigned int num)
+{
+  if (num > m_cacheBits)
+  {
+    refill();
+    if (num > m_cacheBits)
     {
+      // what is left, like reading bit by bit up to the end
+      unsigned int r = m_cacheBits ? m_cache >> (64 - m_cacheBits) : 0;
+      consume(m_cacheBits);
       m_error = true;
-      break;
+      return r;
     }
-
-    r <<= 1;
-    if (m_data[m_offset >> 3] & m_bitMask[m_offset & 7])
-      r |= 1;
-    num--;
-    m_offset++;
   }
+  if (!num)
+    return 0;
+
+  unsigned int r = m_cache >> (64 - num);
+  consume(num);
   return r;
 }
 
 unsigned int cBitstream::showBits(unsigned int num)
 {
-  unsigned int r;
-  unsigned int offs = m_offset;
-
-  r = readBits(num);
-  m_offset = offs;
-  return r;
+  if (num > m_cacheBits)
+  {
+    refill();
+    if (num > m_cacheBits)
+    {
+      m_error = true;
+      return m_cacheBits ? m_cache >> (64 - m_cacheBits) : 0;
+    }
+  }
+  return num ? m_cache >> (64 - num) : 0;
 }
 
 unsigned int cBitstream::readGolombUE(unsigned int maxbits)
 {
-  int lzb = -1;
-  unsigned int bits = 0;
+  if (m_cacheBits <= maxbits)
+    refill();
 
-  for (int b = 0; !b; lzb++, bits++)
+  // with no 1 in the cache there are more than maxbits leading zeros or
+  // the data ends, either way maxbits + 1 bits are gone
+  int lzb = m_cache ? __builtin_clzll(m_cache) : 64;
+  if ((unsigned int)lzb > maxbits)
   {
-    if (bits > maxbits)
-      return 0;
-    b = readBits1();
+    skipBits(maxbits + 1);
+    return 0;
   }
 
+  consume(lzb + 1);
   return (1 << lzb) - 1 + readBits(lzb);
 }
 
@@ -160,46 +183,3 @@ signed int cBitstream::readGolombSE()
   v = (v + 1) >> 1;
   return pos ? v : -v;
 }
-
-
-
-// Todo: are these two functions needed anyway?
-
-unsigned int cBitstream::remainingBits()
-{
-  if (m_doEP3)
-  {
-    m_error = true;  // can't tell because of EP3 bytes
-    return 0;
-  }
-  else
-     return m_len - m_offset;
-}
-
-
-void cBitstream::putBits(int val, int num)
-{
-  if (m_doEP3)  // cannot insert possible EP3 bytes -> fail always
-  {
-    m_error = true;
-    return;
-  }
-
-  while (num > 0) {
-    if (m_offset >= m_len)
-    {
-      m_error = true;
-      return;
-    }
-
-    num--;
-
-    if (val & (1 << num))
-      m_data[m_offset / 8] |=  m_bitMask[m_offset & 7];
-    else
-      m_data[m_offset / 8] &= ~m_bitMask[m_offset & 7];
-
-    m_offset++;
-  }
-}
-
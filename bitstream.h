@@ -31,11 +31,16 @@ class cBitstream
 {
 private:
   uint8_t *m_data;
-  int      m_offset;
+  int      m_pos;        // next byte to go into the cache
+  int      m_end;
   int      m_len;
+  uint64_t m_cache;      // next bits, MSB first, unused bits are 0
+  unsigned int m_cacheBits;
   bool     m_error;
   bool     m_doEP3;
-  static constexpr uint8_t m_bitMask[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+
+  void         refill();
+  void         consume(unsigned int num);
 
 public:
   cBitstream(uint8_t *data, unsigned int bits);
@@ -48,8 +53,6 @@ public:
   unsigned int readBits1() { return readBits(1); }
   unsigned int readGolombUE(unsigned int maxbits = 32);
   signed int   readGolombSE();
-  unsigned int remainingBits();
-  void         putBits(int val, int num);
   int          length() { return m_len; }
   bool         isError() { return m_error; }
 };
@@ -53,6 +53,10 @@
 #define MSG_MORE 0
 #endif
 
+#ifndef SO_MAX_PACING_RATE
+#define SO_MAX_PACING_RATE 47
+#endif
+
 cxSocket::~cxSocket()
 {
   close();
@@ -124,6 +128,21 @@ ssize_t cxSocket::write(const void *buffer, size_t size, int timeout_ms, bool mo
   return written;
 }
 
+// caps the rate the kernel sends at, 0 removes the cap
+bool cxSocket::SetPacingRate(uint32_t bytesPerSecond)
+{
+  if(m_fd == -1)
+    return false;
+
+#ifdef __linux__
+  uint32_t rate = bytesPerSecond ? bytesPerSecond : ~0U;
+  if (setsockopt(m_fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) == 0)
+    return true;
+  DEBUGLOG("cxSocket::SetPacingRate(fd=%d): setsockopt() failed", m_fd);
+#endif
+  return false;
+}
+
 ssize_t cxSocket::read(void *buffer, size_t size, int timeout_ms)
 {
   int retryCounter = 0;
@@ -55,6 +55,7 @@ class cxSocket
   void UnlockWrite();
   ssize_t read(void *buffer, size_t size, int timeout_ms = -1);
   ssize_t write(const void *buffer, size_t size, int timeout_ms = -1, bool more_data = false);
+  bool SetPacingRate(uint32_t bytesPerSecond);
   static char *ip2txt(uint32_t ip, unsigned int port, char *str);
 };
 
@@ -31,9 +31,18 @@
 #include <vdr/channels.h>
 #include <libsi/si.h>
 
+#define DEMUX_SPAN_SIZE  (TS_SIZE * 64)
+#define DEMUX_MAX_SPANS  4
+
 cVNSIDemuxer::cVNSIDemuxer(bool bAllowRDS)
  : m_bAllowRDS(bAllowRDS)
 {
+  m_VideoBuffer = NULL;
+  m_SpanBuf = NULL;
+  m_SpanLen = 0;
+  m_SpanPos = 0;
+  m_StreamsIndex = 0;
+  memset(m_PidTable, 0, sizeof(m_PidTable));
 }
 
 cVNSIDemuxer::~cVNSIDemuxer()
@@ -47,6 +56,9 @@ void cVNSIDemuxer::Open(const cChannel &channel, cVideoBuffer *videoBuffer)
 
   m_CurrentChannel = channel;
   m_VideoBuffer = videoBuffer;
+  m_SpanBuf = NULL;
+  m_SpanLen = 0;
+  m_SpanPos = 0;
 
   if (m_CurrentChannel.Vpid())
     m_WaitIFrame = true;
@@ -59,106 +71,187 @@ void cVNSIDemuxer::Open(const cChannel &channel, cVideoBuffer *videoBuffer)
   m_MuxPacketSerial = 0;
   m_Error = ERROR_DEMUX_NODATA;
   m_SetRefTime = true;
+  m_HasBuffer = videoBuffer->HasBuffer();
 }
 
 void cVNSIDemuxer::Close()
 {
   cMutexLock lock(&m_Mutex);
 
-  for (std::list<cTSStream*>::iterator it = m_Streams.begin(); it != m_Streams.end(); ++it)
+  for (std::vector<cTSStream*>::iterator it = m_Streams.begin(); it != m_Streams.end(); ++it)
   {
     DEBUGLOG("Deleting stream parser for pid=%i and type=%i", (*it)->GetPID(), (*it)->Type());
     delete (*it);
   }
   m_Streams.clear();
   m_StreamInfos.clear();
+  BuildPidTable();
+  m_SpanBuf = NULL;
+  m_SpanLen = 0;
+  m_SpanPos = 0;
 }
 
-int cVNSIDemuxer::Read(sStreamPacket *packet, sStreamPacket *packet_side_data)
+int cVNSIDemuxer::Read(sStreamPacket *packets, sStreamPacket *packets_side_data, int maxPackets)
 {
-  uint8_t *buf;
-  int len;
+  cTSStream *batchStreams[DEMUX_BATCH_SIZE];
   cTSStream *stream;
+  int count = 0;
+  int spans = 0;
+
+  if (!packets || maxPackets <= 0)
+    return -1;
+  if (maxPackets > DEMUX_BATCH_SIZE)
+    maxPackets = DEMUX_BATCH_SIZE;
 
   cMutexLock lock(&m_Mutex);
 
-  // clear packet
-  if (!packet)
-    return -1;
-  packet->data = NULL;
-  packet->streamChange = false;
-  packet->pmtChange = false;
-
-  // read TS Packet from buffer
-  len = m_VideoBuffer->Read(&buf, TS_SIZE, m_endTime, m_wrapTime);
-  // eof
-  if (len == -2)
-    return -2;
-  else if (len != TS_SIZE)
-    return -1;
+  while (count < maxPackets)
+  {
+    // fetch next span of TS packets from buffer
+    if (m_SpanPos >= m_SpanLen)
+    {
+      if (++spans > DEMUX_MAX_SPANS)
+        break;
 
-  m_Error &= ~ERROR_DEMUX_NODATA;
+      m_SpanPos = 0;
+      m_SpanLen = m_VideoBuffer->Read(&m_SpanBuf, DEMUX_SPAN_SIZE, m_endTime, m_wrapTime);
+      if (m_SpanLen <= 0)
+      {
+        int ret = m_SpanLen;
+        m_SpanLen = 0;
+        if (count)
+          break;
+        // eof
+        if (ret == -2)
+          return -2;
+        return -1;
+      }
+      m_Error &= ~ERROR_DEMUX_NODATA;
 
-  int ts_pid = TsPid(buf);
+      // the live ring was promoted, time line starts with the new buffer
+      if (!m_HasBuffer && m_VideoBuffer->HasBuffer())
+      {
+        m_HasBuffer = true;
+        m_SetRefTime = true;
+      }
+    }
 
-  // parse PAT/PMT
-  if (ts_pid == PATPID)
-  {
-    m_PatPmtParser.ParsePat(buf, TS_SIZE);
-  }
+    uint8_t *buf = m_SpanBuf + m_SpanPos;
+    int ts_pid = TsPid(buf);
+
+    // parse PAT/PMT
+    if (ts_pid == PATPID)
+    {
+      m_PatPmtParser.ParsePat(buf, TS_SIZE);
+    }
 #if APIVERSNUM >= 10733
-  else if (m_PatPmtParser.IsPmtPid(ts_pid))
+    else if (m_PatPmtParser.IsPmtPid(ts_pid))
 #else
-  else if (ts_pid == m_PatPmtParser.PmtPid())
+    else if (ts_pid == m_PatPmtParser.PmtPid())
 #endif
-  {
-    int patVersion, pmtVersion;
-    m_PatPmtParser.ParsePmt(buf, TS_SIZE);
-    if (m_PatPmtParser.GetVersions(patVersion, pmtVersion))
     {
-      cChannel pmtChannel(m_CurrentChannel);
-      SetChannelPids(&pmtChannel, &m_PatPmtParser);
-      SetChannelStreams(&pmtChannel);
-      m_PatPmtParser.Reset();
-      if (EnsureParsers())
+      // a pmt change may delete streams, hand out pending packets first
+      if (count)
+        break;
+
+      m_SpanPos += TS_SIZE;
+
+      int patVersion, pmtVersion;
+      m_PatPmtParser.ParsePmt(buf, TS_SIZE);
+      if (m_PatPmtParser.GetVersions(patVersion, pmtVersion))
       {
-        packet->pmtChange = true;
-        return 1;
+        cChannel pmtChannel(m_CurrentChannel);
+        SetChannelPids(&pmtChannel, &m_PatPmtParser);
+        SetChannelStreams(&pmtChannel);
+        m_PatPmtParser.Reset();
+        if (EnsureParsers())
+        {
+          packets[0].data = NULL;
+          packets[0].streamChange = false;
+          packets[0].pmtChange = true;
+          packets[0].reftime = 0;
+          packets_side_data[0].data = NULL;
+          return 1;
+        }
       }
+      continue;
     }
-  }
-  else if (stream = FindStream(ts_pid))
-  {
-    int error = stream->ProcessTSPacket(buf, packet, packet_side_data, m_WaitIFrame);
-    if (error == 0)
+    else if (stream = FindStream(ts_pid))
     {
-      m_WaitIFrame = false;
+      // packet data points into the parser's buffer which is reused
+      // by the next TS packet of that stream
+      int i;
+      for (i = 0; i < count; i++)
+      {
+        if (batchStreams[i] == stream)
+          break;
+      }
+      if (i < count)
+        break;
 
-      packet->serial = m_MuxPacketSerial;
-      if (m_SetRefTime)
+      sStreamPacket *packet = &packets[count];
+      sStreamPacket *packet_side_data = &packets_side_data[count];
+      packet->data = NULL;
+      packet->streamChange = false;
+      packet->pmtChange = false;
+      packet->reftime = 0;
+      packet->frametype = 0;
+      packet_side_data->data = NULL;
+      packet_side_data->frametype = 0;
+
+      int error = stream->ProcessTSPacket(buf, packet, packet_side_data, m_WaitIFrame);
+      if (error == 0)
       {
-        m_refTime = m_VideoBuffer->GetRefTime();
-        packet->reftime = m_refTime;
-        m_SetRefTime = false;
+        m_WaitIFrame = false;
+
+        packet->serial = m_MuxPacketSerial;
+        if (m_SetRefTime)
+        {
+          m_refTime = m_VideoBuffer->GetRefTime();
+          packet->reftime = m_refTime;
+          m_SetRefTime = false;
+        }
+        batchStreams[count++] = stream;
       }
-      return 1;
-    }
-    else if (error < 0)
-    {
-      m_Error |= abs(error);
-      if (m_Error & ERROR_PES_SCRAMBLE)
+      else if (error < 0)
       {
-        if (!m_WaitIFrame)
+        m_Error |= abs(error);
+        if (m_Error & ERROR_PES_SCRAMBLE)
         {
-          ResetParsers();
-          m_Error |= ERROR_CAM_ERROR;
-          m_WaitIFrame = true;
+          if (!m_WaitIFrame)
+          {
+            ResetParsers();
+            m_Error |= ERROR_CAM_ERROR;
+            m_WaitIFrame = true;
+          }
         }
       }
     }
+
+    m_SpanPos += TS_SIZE;
+  }
+
+  return count;
+}
+
+// the stream was demuxed without being sent, start over for a new client
+// session at the last keyframe in the buffer, or else at the next one
+void cVNSIDemuxer::Resume()
+{
+  cMutexLock lock(&m_Mutex);
+
+  off_t pos;
+  if (m_VideoBuffer->LastKeyframe(&pos))
+  {
+    m_SpanLen = 0;
+    m_SpanPos = 0;
+    m_VideoBuffer->SetPos(pos);
   }
 
-  return 0;
+  ResetParsers();
+  m_WaitIFrame = m_CurrentChannel.Vpid() != 0;
+  m_MuxPacketSerial = 0;
+  m_SetRefTime = true;
 }
 
 bool cVNSIDemuxer::SeekTime(int64_t time)
@@ -172,11 +265,25 @@ bool cVNSIDemuxer::SeekTime(int64_t time)
 
   cMutexLock lock(&m_Mutex);
 
+  // drop remainder of current span, buffer position is going to change
+  m_SpanLen = 0;
+  m_SpanPos = 0;
+
 //  INFOLOG("----- seek to time: %ld", time);
 
   // rescale to 90khz
   time = cTSStream::Rescale(time, 90000, DVD_TIME_BASE);
 
+  // land directly on a keyframe if the buffer indexed one
+  if (m_VideoBuffer->FindKeyframe(time, &pos))
+  {
+    m_VideoBuffer->SetPos(pos);
+    ResetParsers();
+    m_WaitIFrame = true;
+    m_MuxPacketSerial++;
+    return true;
+  }
+
   m_VideoBuffer->GetPositions(&pos, &pos_min, &pos_max);
 
 //  INFOLOG("----- seek to time: %ld", time);
@@ -322,6 +429,37 @@ bool cVNSIDemuxer::SeekTime(int64_t time)
   return true;
 }
 
+// start and end are wall-clock times as sent with the buffer status
+bool cVNSIDemuxer::Export(time_t start, time_t end, const char *name)
+{
+  if (!m_VideoBuffer->HasBuffer())
+    return false;
+
+  cMutexLock lock(&m_Mutex);
+  return m_VideoBuffer->Export(start, end, &m_CurrentChannel, name);
+}
+
+// keep the stream from here on, the client paused
+bool cVNSIDemuxer::Promote()
+{
+  cMutexLock lock(&m_Mutex);
+  return m_VideoBuffer->Promote();
+}
+
+// the reader has not caught up with the write head of a timeshift buffer
+bool cVNSIDemuxer::IsBehindLive()
+{
+  cMutexLock lock(&m_Mutex);
+  if (!m_HasBuffer)
+    return false;
+  if (m_SpanPos < m_SpanLen)
+    return true;
+
+  off_t cur, min, max;
+  m_VideoBuffer->GetPositions(&cur, &min, &max);
+  return cur < max;
+}
+
 void cVNSIDemuxer::BufferStatus(bool &timeshift, uint32_t &start, uint32_t &end)
 {
   timeshift = m_VideoBuffer->HasBuffer();
@@ -347,35 +485,32 @@ void cVNSIDemuxer::BufferStatus(bool &timeshift, uint32_t &start, uint32_t &end)
 
 cTSStream *cVNSIDemuxer::GetFirstStream()
 {
-  m_StreamsIterator = m_Streams.begin();
-  if (m_StreamsIterator != m_Streams.end())
-    return *m_StreamsIterator;
+  m_StreamsIndex = 0;
+  if (m_StreamsIndex < m_Streams.size())
+    return m_Streams[m_StreamsIndex];
   else
     return NULL;
 }
 
 cTSStream *cVNSIDemuxer::GetNextStream()
 {
-  ++m_StreamsIterator;
-  if (m_StreamsIterator != m_Streams.end())
-    return *m_StreamsIterator;
+  ++m_StreamsIndex;
+  if (m_StreamsIndex < m_Streams.size())
+    return m_Streams[m_StreamsIndex];
   else
     return NULL;
 }
 
-cTSStream *cVNSIDemuxer::FindStream(int Pid)
+void cVNSIDemuxer::BuildPidTable()
 {
-  for (std::list<cTSStream*>::iterator it = m_Streams.begin(); it != m_Streams.end(); ++it)
-  {
-    if (Pid == (*it)->GetPID())
-      return *it;
-  }
-  return NULL;
+  memset(m_PidTable, 0, sizeof(m_PidTable));
+  for (size_t i = 0; i < m_Streams.size(); i++)
+    m_PidTable[m_Streams[i]->GetPID() & (DEMUX_PID_COUNT - 1)] = i + 1;
 }
 
 void cVNSIDemuxer::ResetParsers()
 {
-  for (std::list<cTSStream*>::iterator it = m_Streams.begin(); it != m_Streams.end(); ++it)
+  for (std::vector<cTSStream*>::iterator it = m_Streams.begin(); it != m_Streams.end(); ++it)
   {
     (*it)->ResetParser();
   }
@@ -390,29 +525,32 @@ bool cVNSIDemuxer::EnsureParsers()
 {
   bool streamChange = false;
 
-  std::list<cTSStream*>::iterator it = m_Streams.begin();
-  while (it != m_Streams.end())
+  // drop streams the PMT does not list anymore, keeping the order
+  size_t kept = 0;
+  for (size_t i = 0; i < m_Streams.size(); i++)
   {
-    std::list<sStreamInfo>::iterator its;
+    cTSStream *stream = m_Streams[i];
+    std::vector<sStreamInfo>::iterator its;
     for (its = m_StreamInfos.begin(); its != m_StreamInfos.end(); ++its)
     {
-      if ((its->pID == (*it)->GetPID()) && (its->type == (*it)->Type()))
+      if ((its->pID == stream->GetPID()) && (its->type == stream->Type()))
       {
         break;
       }
     }
     if (its == m_StreamInfos.end())
     {
-      INFOLOG("Deleting stream for pid=%i and type=%i", (*it)->GetPID(), (*it)->Type());
-      m_Streams.erase(it);
-      it = m_Streams.begin();
+      INFOLOG("Deleting stream for pid=%i and type=%i", stream->GetPID(), stream->Type());
+      delete stream;
       streamChange = true;
     }
     else
-      ++it;
+      m_Streams[kept++] = stream;
   }
+  m_Streams.resize(kept);
+  BuildPidTable();
 
-  for (std::list<sStreamInfo>::iterator it = m_StreamInfos.begin(); it != m_StreamInfos.end(); ++it)
+  for (std::vector<sStreamInfo>::iterator it = m_StreamInfos.begin(); it != m_StreamInfos.end(); ++it)
   {
     cTSStream *stream = FindStream(it->pID);
     if (stream)
@@ -422,6 +560,12 @@ bool cVNSIDemuxer::EnsureParsers()
       continue;
     }
 
+    if (m_Streams.size() >= DEMUX_MAX_STREAMS)
+    {
+      ERRORLOG("Too many streams, ignoring pid=%i", it->pID);
+      continue;
+    }
+
     if (it->type == stH264)
     {
       stream = new cTSStream(stH264, it->pID, &m_PtsWrap);
@@ -475,6 +619,7 @@ bool cVNSIDemuxer::EnsureParsers()
       continue;
 
     m_Streams.push_back(stream);
+    m_PidTable[stream->GetPID() & (DEMUX_PID_COUNT - 1)] = m_Streams.size();
     INFOLOG("Created stream for pid=%i and type=%i", stream->GetPID(), stream->Type());
     streamChange = true;
   }
@@ -508,17 +653,14 @@ void cVNSIDemuxer::SetChannelStreams(const cChannel *channel)
   index = 0;
   for ( ; *DPids; DPids++)
   {
-    if (!FindStream(*DPids))
-    {
-      newStream.pID = *DPids;
-      newStream.type = stAC3;
+    newStream.pID = *DPids;
+    newStream.type = stAC3;
 #if APIVERSNUM >= 10715
-      if (channel->Dtype(index) == SI::EnhancedAC3DescriptorTag)
-        newStream.type = stEAC3;
+    if (channel->Dtype(index) == SI::EnhancedAC3DescriptorTag)
+      newStream.type = stEAC3;
 #endif
-      newStream.SetLanguage(channel->Dlang(index));
-      AddStreamInfo(newStream);
-    }
+    newStream.SetLanguage(channel->Dlang(index));
+    AddStreamInfo(newStream);
     index++;
   }
 
@@ -526,20 +668,17 @@ void cVNSIDemuxer::SetChannelStreams(const cChannel *channel)
   index = 0;
   for ( ; *APids; APids++)
   {
-    if (!FindStream(*APids))
-    {
-      newStream.pID = *APids;
-      newStream.type = stMPEG2AUDIO;
+    newStream.pID = *APids;
+    newStream.type = stMPEG2AUDIO;
 #if APIVERSNUM >= 10715
-      if (channel->Atype(index) == 0x0F)
-        newStream.type = stAACADTS;
-      else if (channel->Atype(index) == 0x11)
-        newStream.type = stAACLATM;
+    if (channel->Atype(index) == 0x0F)
+      newStream.type = stAACADTS;
+    else if (channel->Atype(index) == 0x11)
+      newStream.type = stAACLATM;
 #endif
-      newStream.handleRDS = m_bAllowRDS && newStream.type == stMPEG2AUDIO && !containsVideo ? true : false; // Relevant for RDS, if present only on mpeg 2 audio, use only if RDS is allowed
-      newStream.SetLanguage(channel->Alang(index));
-      AddStreamInfo(newStream);
-    }
+    newStream.handleRDS = m_bAllowRDS && newStream.type == stMPEG2AUDIO && !containsVideo ? true : false; // Relevant for RDS, if present only on mpeg 2 audio, use only if RDS is allowed
+    newStream.SetLanguage(channel->Alang(index));
+    AddStreamInfo(newStream);
     index++;
   }
 
@@ -549,18 +688,15 @@ void cVNSIDemuxer::SetChannelStreams(const cChannel *channel)
     index = 0;
     for ( ; *SPids; SPids++)
     {
-      if (!FindStream(*SPids))
-      {
-        newStream.pID = *SPids;
-        newStream.type = stDVBSUB;
-        newStream.SetLanguage(channel->Slang(index));
+      newStream.pID = *SPids;
+      newStream.type = stDVBSUB;
+      newStream.SetLanguage(channel->Slang(index));
 #if APIVERSNUM >= 10709
-        newStream.subtitlingType = channel->SubtitlingType(index);
-        newStream.compositionPageId = channel->CompositionPageId(index);
-        newStream.ancillaryPageId = channel->AncillaryPageId(index);
+      newStream.subtitlingType = channel->SubtitlingType(index);
+      newStream.compositionPageId = channel->CompositionPageId(index);
+      newStream.ancillaryPageId = channel->AncillaryPageId(index);
 #endif
-        AddStreamInfo(newStream);
-      }
+      AddStreamInfo(newStream);
       index++;
     }
   }
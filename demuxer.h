@@ -24,7 +24,7 @@
 
 #pragma once
 
-#include <list>
+#include <vector>
 #include "parser.h"
 
 struct sStreamPacket;
@@ -33,6 +33,10 @@ class cChannel;
 class cPatPmtParser;
 class cVideoBuffer;
 
+#define DEMUX_BATCH_SIZE 32
+#define DEMUX_PID_COUNT  0x2000
+#define DEMUX_MAX_STREAMS 255
+
 struct sStreamInfo
 {
   int pID;
@@ -57,12 +61,16 @@ class cVNSIDemuxer
 public:
   cVNSIDemuxer(bool bAllowRDS);
   virtual ~cVNSIDemuxer();
-  int Read(sStreamPacket *packet, sStreamPacket *packet_side_data);
+  int Read(sStreamPacket *packets, sStreamPacket *packets_side_data, int maxPackets);
   cTSStream *GetFirstStream();
   cTSStream *GetNextStream();
   void Open(const cChannel &channel, cVideoBuffer *videoBuffer);
   void Close();
   bool SeekTime(int64_t time);
+  void Resume();
+  bool Export(time_t start, time_t end, const char *name);
+  bool Promote();
+  bool IsBehindLive();
   uint32_t GetSerial() { return m_MuxPacketSerial; }
   void SetSerial(uint32_t serial) { m_MuxPacketSerial = serial; }
   void BufferStatus(bool &timeshift, uint32_t &start, uint32_t &end);
@@ -73,21 +81,31 @@ protected:
   void ResetParsers();
   void SetChannelStreams(const cChannel *channel);
   void SetChannelPids(cChannel *channel, cPatPmtParser *patPmtParser);
-  cTSStream *FindStream(int Pid);
+  cTSStream *FindStream(int Pid)
+  {
+    uint8_t index = m_PidTable[Pid & (DEMUX_PID_COUNT - 1)];
+    return index ? m_Streams[index - 1] : NULL;
+  }
+  void BuildPidTable();
   void AddStreamInfo(sStreamInfo &stream);
   bool GetTimeAtPos(off_t *pos, int64_t *time);
-  std::list<cTSStream*> m_Streams;
-  std::list<cTSStream*>::iterator m_StreamsIterator;
-  std::list<sStreamInfo> m_StreamInfos;
+  std::vector<cTSStream*> m_Streams;
+  size_t m_StreamsIndex;
+  std::vector<sStreamInfo> m_StreamInfos;
+  uint8_t m_PidTable[DEMUX_PID_COUNT];              /*!> Index into m_Streams plus one per PID, 0 if not demuxed */
   cChannel m_CurrentChannel;
   cPatPmtParser m_PatPmtParser;
   bool m_WaitIFrame;
   cVideoBuffer *m_VideoBuffer;
+  uint8_t *m_SpanBuf;
+  int m_SpanLen;
+  int m_SpanPos;
   cMutex m_Mutex;
   uint32_t m_MuxPacketSerial;
   sPtsWrap m_PtsWrap;
   uint16_t m_Error;
   bool m_SetRefTime;
+  bool m_HasBuffer;
   time_t m_refTime, m_endTime, m_wrapTime;
   bool m_bAllowRDS;
 };
@@ -0,0 +1,114 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "iopriority.h"
+#include "config.h"
+
+#include <atomic>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// not in the C library headers, see linux/ioprio.h
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_BE    2
+#define IOPRIO_CLASS_IDLE  3
+#define IOPRIO_WHO_PROCESS 1
+
+// best-effort levels 0 (high) to 7 (low), unset threads are at 4
+#define IOPRIO_LEVEL_TIMESHIFT 6
+#define IOPRIO_LEVEL_PLAYBACK  1
+
+struct sIOCounters
+{
+  std::atomic<uint64_t> ops;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> busyUs;
+  std::atomic<uint64_t> maxUs;
+};
+
+static sIOCounters counters[IOCLASS_COUNT];
+static uint64_t reportStart = cIOPriority::Now();
+
+static const char *classNames[IOCLASS_COUNT] = { "timeshift", "playback", "bulk" };
+
+void cIOPriority::Set(eIOClass ioclass)
+{
+  int prio;
+  if (ioclass == IOCLASS_BULK)
+    prio = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+  else if (ioclass == IOCLASS_TIMESHIFT)
+    prio = (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | IOPRIO_LEVEL_TIMESHIFT;
+  else
+    prio = (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | IOPRIO_LEVEL_PLAYBACK;
+
+  // who 0 is the calling thread
+#ifdef SYS_ioprio_set
+  if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, prio) < 0)
+    DEBUGLOG("Could not set %s I/O priority: %m", classNames[ioclass]);
+#endif
+}
+
+uint64_t cIOPriority::Now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void cIOPriority::Account(eIOClass ioclass, ssize_t bytes, uint64_t startUs)
+{
+  if (bytes < 0)
+    return;
+
+  sIOCounters &c = counters[ioclass];
+  uint64_t us = Now() - startUs;
+  c.ops++;
+  c.bytes += bytes;
+  c.busyUs += us;
+  uint64_t max = c.maxUs.load(std::memory_order_relaxed);
+  while (us > max && !c.maxUs.compare_exchange_weak(max, us))
+    ;
+}
+
+cString cIOPriority::Report()
+{
+  uint64_t elapsed = (Now() - reportStart) / 1000000;
+  if (!elapsed)
+    elapsed = 1;
+
+  cString report = cString::sprintf("%-9s %9s %7s %8s %7s %7s", "class", "ops", "MB", "kB/s", "avg ms", "max ms");
+  for (int i = 0; i < IOCLASS_COUNT; i++)
+  {
+    sIOCounters &c = counters[i];
+    uint64_t ops = c.ops;
+    uint64_t bytes = c.bytes;
+    report = cString::sprintf("%s\n%-9s %9llu %7llu %8llu %7.1f %7.1f", (const char*)report, classNames[i],
+                              (unsigned long long)ops, (unsigned long long)(bytes >> 20),
+                              (unsigned long long)(bytes / 1024 / elapsed),
+                              ops ? c.busyUs / 1000.0 / ops : 0.0, c.maxUs / 1000.0);
+  }
+  return report;
+}
@@ -0,0 +1,52 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <vdr/tools.h>
+
+/*!
+ * Disk I/O classes of the plugin. Each thread doing disk I/O sets the
+ * class of its work once, the kernel then schedules it against VDR's own
+ * recorders, which stay in the default best-effort level.
+ */
+enum eIOClass
+{
+  IOCLASS_TIMESHIFT,    /*!> Timeshift writes, best-effort low */
+  IOCLASS_PLAYBACK,     /*!> Reads a client is waiting for, best-effort high */
+  IOCLASS_BULK,         /*!> Exports and other copies, idle */
+  IOCLASS_COUNT
+};
+
+class cIOPriority
+{
+public:
+  static void Set(eIOClass ioclass);
+  static void Account(eIOClass ioclass, ssize_t bytes, uint64_t startUs);
+  static uint64_t Now();
+  static cString Report();
+};
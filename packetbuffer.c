@@ -0,0 +1,388 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "packetbuffer.h"
+#include "config.h"
+#include "vnsi.h"
+#include "parser.h"
+#include "videobuffer.h"
+
+#include <algorithm>
+
+#define PACKETBUFFER_CHUNK_SIZE MEGABYTE(4)
+#define PACKETBUFFER_ALIGN      8
+
+// records are spaced at least this far in the keyframe index, radio
+// channels index every packet
+#define PACKETBUFFER_KEYFRAME_INTERVAL (DVD_TIME_BASE / 2)
+
+#define PACKET_RECORD_DATA   1
+#define PACKET_RECORD_CHANGE 2
+#define PACKET_RECORD_REPEAT 3
+#define PACKET_RECORD_END    4
+
+// header in front of each record
+struct sRecord
+{
+  uint32_t size;
+  uint8_t  kind;
+  uint8_t  frametype;
+  uint16_t reserved;
+  int64_t  id;
+  int64_t  pts;
+  int64_t  dts;
+  int32_t  duration;
+  uint32_t reftime;
+};
+
+static inline unsigned int RecordLength(unsigned int size)
+{
+  return (sizeof(sRecord) + size + PACKETBUFFER_ALIGN - 1) & ~(PACKETBUFFER_ALIGN - 1);
+}
+
+cPacketBuffer::cPacketBuffer()
+{
+  m_Head = 0;
+  m_Tail = 0;
+  m_WritePos = 0;
+  m_ChangePos = 0;
+  m_ChangeDue = false;
+  m_Dropping = false;
+  m_ReadPos = 0;
+  m_NextPos = 0;
+  m_SkipTo = 0;
+  m_ReadChangeDue = false;
+  m_Serial = 0;
+  m_LastTime = 0;
+  m_OverflowCount = 0;
+  cVideoBufferPool::Instance().Attach();
+}
+
+cPacketBuffer::~cPacketBuffer()
+{
+  cVideoBufferPool &pool = cVideoBufferPool::Instance();
+  for (size_t i = 0; i < m_Chunks.size(); i++)
+  {
+    if (m_Chunks[i])
+      pool.Release(PACKETBUFFER_CHUNK_SIZE);
+    free(m_Chunks[i]);
+  }
+  pool.Detach();
+}
+
+cPacketBuffer *cPacketBuffer::Create()
+{
+  cPacketBuffer *buffer = new cPacketBuffer();
+  if (!buffer->Init())
+  {
+    delete buffer;
+    return NULL;
+  }
+  return buffer;
+}
+
+bool cPacketBuffer::Init()
+{
+  size_t chunks = (off_t)TimeshiftBufferSize*100*1000*1000 / PACKETBUFFER_CHUNK_SIZE;
+  if (chunks < 2)
+    chunks = 2;
+  INFOLOG("allocated packet buffer with max size: %ld", (long)(chunks * PACKETBUFFER_CHUNK_SIZE));
+  m_Chunks.resize(chunks, NULL);
+  m_ChunkTime.resize(chunks, 0);
+  return NextChunk(0);
+}
+
+uint8_t *cPacketBuffer::At(uint64_t pos)
+{
+  return m_Chunks[(pos / PACKETBUFFER_CHUNK_SIZE) % m_Chunks.size()] + pos % PACKETBUFFER_CHUNK_SIZE;
+}
+
+// called by the writer before it enters the chunk at pos. Chunks count
+// against the memory budget of the timeshift buffers, once it is used up
+// the ring wraps at the chunks it has.
+bool cPacketBuffer::NextChunk(uint64_t pos)
+{
+  uint64_t chunk = pos / PACKETBUFFER_CHUNK_SIZE;
+  size_t count = m_Chunks.size();
+  size_t slot = chunk % count;
+
+  if (!m_Chunks[slot])
+  {
+    // still in the first lap, the chunks before are all allocated
+    cVideoBufferPool &pool = cVideoBufferPool::Instance();
+    if (!pool.Reserve(PACKETBUFFER_CHUNK_SIZE, chunk < 2))
+    {
+      cMutexLock lock(&m_Mutex);
+      INFOLOG("memory budget used up, packet buffer stays at %ld", (long)(chunk * PACKETBUFFER_CHUNK_SIZE));
+      m_Chunks.resize(chunk);
+      m_ChunkTime.resize(chunk);
+      count = chunk;
+      slot = 0;
+    }
+    else
+    {
+      m_Chunks[slot] = (uint8_t*)malloc(PACKETBUFFER_CHUNK_SIZE);
+      if (!m_Chunks[slot])
+      {
+        pool.Release(PACKETBUFFER_CHUNK_SIZE);
+        ERRORLOG("Could not allocate packet buffer chunk");
+        return false;
+      }
+    }
+  }
+
+  cMutexLock lock(&m_Mutex);
+
+  if (chunk >= count)
+  {
+    // the oldest chunk is given up, unless the reader is still in it
+    if (m_ReadPos / PACKETBUFFER_CHUNK_SIZE <= chunk - count)
+      return false;
+    m_Tail = (chunk - count + 1) * PACKETBUFFER_CHUNK_SIZE;
+    while (!m_Index.empty() && m_Index.front().change < m_Tail)
+      m_Index.pop_front();
+  }
+  m_ChunkTime[slot] = time(NULL);
+  return true;
+}
+
+unsigned int cPacketBuffer::Write(uint64_t pos, uint8_t kind, const sStreamPacket *pkt, const uint8_t *data, unsigned int size)
+{
+  sRecord *record = (sRecord*)At(pos);
+  memset(record, 0, sizeof(sRecord));
+  record->size = size;
+  record->kind = kind;
+  if (pkt)
+  {
+    record->frametype = pkt->frametype;
+    record->id = pkt->id;
+    record->pts = pkt->pts;
+    record->dts = pkt->dts;
+    record->duration = pkt->duration;
+    record->reftime = pkt->reftime;
+  }
+  memcpy(record + 1, data, size);
+  return RecordLength(size);
+}
+
+// records don't cross chunks, the rest of a chunk is skipped if the next
+// one doesn't fit
+bool cPacketBuffer::Append(uint8_t kind, const sStreamPacket *pkt, const uint8_t *data, unsigned int size, uint64_t *at)
+{
+  unsigned int len = RecordLength(size);
+  unsigned int repeat = 0;
+  if (kind != PACKET_RECORD_CHANGE && !m_Change.empty())
+    repeat = RecordLength(m_Change.size());
+  if (len + repeat > PACKETBUFFER_CHUNK_SIZE)
+    return false;
+
+  m_LastTime.store(time(NULL), std::memory_order_relaxed);
+
+  uint64_t pos = m_WritePos;
+  unsigned int offset = pos % PACKETBUFFER_CHUNK_SIZE;
+  if (offset && offset + len > PACKETBUFFER_CHUNK_SIZE)
+  {
+    if (PACKETBUFFER_CHUNK_SIZE - offset >= sizeof(sRecord))
+      Write(pos, PACKET_RECORD_END, NULL, NULL, 0);
+    pos += PACKETBUFFER_CHUNK_SIZE - offset;
+    offset = 0;
+  }
+  if (!offset && pos)
+  {
+    if (!NextChunk(pos))
+      return false;
+    // each chunk starts with the stream layout it was written with
+    if (repeat)
+    {
+      m_ChangePos = pos;
+      pos += Write(pos, PACKET_RECORD_REPEAT, NULL, m_Change.data(), m_Change.size());
+    }
+  }
+
+  if (kind == PACKET_RECORD_CHANGE)
+    m_ChangePos = pos;
+  Write(pos, kind, pkt, data, size);
+  if (at)
+    *at = pos;
+  m_WritePos = pos + len;
+  m_Head.store(m_WritePos, std::memory_order_release);
+  m_DataEvent.Notify(len);
+  return true;
+}
+
+// the layout is written in front of the next packet
+void cPacketBuffer::PutChange(const uint8_t *msg, int len)
+{
+  m_Change.assign(msg, msg + len);
+  m_ChangeDue = true;
+}
+
+void cPacketBuffer::Put(const sStreamPacket *pkt, bool keyframe)
+{
+  // after an overflow start over at a keyframe
+  if (m_Dropping && !keyframe)
+    return;
+
+  uint64_t pos;
+  if ((m_ChangeDue && !Append(PACKET_RECORD_CHANGE, NULL, m_Change.data(), m_Change.size())) ||
+      !Append(PACKET_RECORD_DATA, pkt, pkt->data, pkt->size, &pos))
+  {
+    if (!m_Dropping)
+    {
+      m_Dropping = true;
+      m_OverflowCount++;
+    }
+    return;
+  }
+  m_ChangeDue = false;
+  m_Dropping = false;
+
+  if (keyframe && pkt->pts != DVD_NOPTS_VALUE)
+  {
+    cMutexLock lock(&m_Mutex);
+
+    // keyframes before a jump of the time line can't be found by PTS
+    if (!m_Index.empty() && pkt->pts < m_Index.back().pts)
+      m_Index.clear();
+    if (m_Index.empty() || pkt->pts - m_Index.back().pts >= PACKETBUFFER_KEYFRAME_INTERVAL)
+    {
+      sKeyframe keyframe;
+      keyframe.pos = pos;
+      keyframe.change = m_ChangePos <= pos ? m_ChangePos : pos;
+      keyframe.pts = pkt->pts;
+      m_Index.push_back(keyframe);
+    }
+  }
+}
+
+// packets point into the buffer and stay valid until the next Read
+int cPacketBuffer::Read(sStreamPacket *packets, int maxPackets)
+{
+  cMutexLock lock(&m_Mutex);
+
+  m_ReadPos = m_NextPos;
+  uint64_t head = m_Head.load(std::memory_order_acquire);
+  uint64_t pos = m_NextPos;
+  int count = 0;
+
+  while (count < maxPackets && pos < head)
+  {
+    unsigned int offset = pos % PACKETBUFFER_CHUNK_SIZE;
+    sRecord *record = (sRecord*)At(pos);
+    if (PACKETBUFFER_CHUNK_SIZE - offset < sizeof(sRecord) || record->kind == PACKET_RECORD_END)
+    {
+      pos += PACKETBUFFER_CHUNK_SIZE - offset;
+      continue;
+    }
+
+    if (record->kind == PACKET_RECORD_CHANGE ||
+        (record->kind == PACKET_RECORD_REPEAT && m_ReadChangeDue))
+    {
+      uint8_t *data = (uint8_t*)(record + 1);
+      m_ReadChange.assign(data, data + record->size);
+      m_ReadChangeDue = true;
+    }
+    else if (record->kind == PACKET_RECORD_DATA && pos >= m_SkipTo)
+    {
+      sStreamPacket *pkt = &packets[count++];
+      pkt->id = record->id;
+      pkt->dts = record->dts;
+      pkt->pts = record->pts;
+      pkt->duration = record->duration;
+      pkt->commercial = 0;
+      pkt->componentindex = 0;
+      pkt->frametype = record->frametype;
+      pkt->data = (uint8_t*)(record + 1);
+      pkt->size = record->size;
+      pkt->streamChange = m_ReadChangeDue && !m_ReadChange.empty();
+      pkt->pmtChange = false;
+      pkt->serial = m_Serial;
+      pkt->reftime = record->reftime;
+      m_ReadChangeDue = false;
+    }
+    pos += RecordLength(record->size);
+  }
+
+  m_NextPos = pos;
+  return count;
+}
+
+// caller holds m_Mutex
+void cPacketBuffer::Jump(const sKeyframe &keyframe)
+{
+  // the last batch may still be sent, keep it until the next Read
+  m_ReadPos = std::min(m_ReadPos, keyframe.change);
+  m_NextPos = keyframe.change;
+  m_SkipTo = keyframe.pos;
+  m_ReadChangeDue = true;
+}
+
+bool cPacketBuffer::Seek(int64_t pts)
+{
+  cMutexLock lock(&m_Mutex);
+
+  if (m_Index.empty())
+    return false;
+
+  // last keyframe at or before pts, or the oldest one
+  size_t lo = 0, hi = m_Index.size();
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (m_Index[mid].pts <= pts)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  Jump(m_Index[lo ? lo - 1 : 0]);
+  m_Serial++;
+  return true;
+}
+
+// start over at the last keyframe
+void cPacketBuffer::Resume()
+{
+  cMutexLock lock(&m_Mutex);
+
+  if (!m_Index.empty())
+    Jump(m_Index.back());
+  else
+    m_ReadChangeDue = true;
+}
+
+// the sender has not caught up with the stream thread
+bool cPacketBuffer::IsBehindLive()
+{
+  cMutexLock lock(&m_Mutex);
+  return m_NextPos < m_Head.load(std::memory_order_acquire);
+}
+
+void cPacketBuffer::BufferStatus(uint32_t &start, uint32_t &end)
+{
+  cMutexLock lock(&m_Mutex);
+
+  start = m_ChunkTime[(m_Tail / PACKETBUFFER_CHUNK_SIZE) % m_Chunks.size()];
+  end = m_LastTime.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,99 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <vdr/thread.h>
+#include "videobuffer.h"
+
+struct sStreamPacket;
+
+/*!
+ * Timeshift store for packets that already went through the demuxer. The
+ * stream thread puts every packet it would have sent, together with the
+ * stream change messages, as records into a ring of RAM chunks, and a sender
+ * replays them from there. Replay and seeks then only copy, the parsers run
+ * once per packet no matter how often it is played. Every chunk starts with
+ * the stream layout that is valid for it, keyframes are indexed by PTS.
+ */
+class cPacketBuffer
+{
+public:
+  static cPacketBuffer *Create();
+  ~cPacketBuffer();
+
+  void Put(const sStreamPacket *pkt, bool keyframe);
+  void PutChange(const uint8_t *msg, int len);
+
+  int Read(sStreamPacket *packets, int maxPackets);
+  const std::vector<uint8_t> &GetChange() { return m_ReadChange; }
+  bool WaitForData(int timeoutMs) { return m_DataEvent.Wait(timeoutMs); }
+  void Wakeup() { m_DataEvent.Wakeup(); }
+  bool Seek(int64_t pts);
+  void Resume();
+  uint32_t GetSerial() { return m_Serial; }
+  bool IsBehindLive();
+  void BufferStatus(uint32_t &start, uint32_t &end);
+  unsigned int GetOverflowCount() { return m_OverflowCount; }
+
+protected:
+  struct sKeyframe
+  {
+    uint64_t pos;
+    uint64_t change;
+    int64_t pts;
+  };
+  cPacketBuffer();
+  bool Init();
+  bool Append(uint8_t kind, const sStreamPacket *pkt, const uint8_t *data, unsigned int size, uint64_t *at = NULL);
+  unsigned int Write(uint64_t pos, uint8_t kind, const sStreamPacket *pkt, const uint8_t *data, unsigned int size);
+  bool NextChunk(uint64_t pos);
+  uint8_t *At(uint64_t pos);
+  void Jump(const sKeyframe &keyframe);
+  cMutex m_Mutex;
+  cVideoBufferEvent m_DataEvent;
+  std::vector<uint8_t*> m_Chunks;
+  std::vector<uint32_t> m_ChunkTime;
+  std::deque<sKeyframe> m_Index;
+  std::vector<uint8_t> m_Change;
+  std::vector<uint8_t> m_ReadChange;
+  std::atomic<uint64_t> m_Head;
+  uint64_t m_Tail;
+  uint64_t m_WritePos;
+  uint64_t m_ChangePos;
+  bool m_ChangeDue;
+  bool m_Dropping;
+  uint64_t m_ReadPos;
+  uint64_t m_NextPos;
+  uint64_t m_SkipTo;
+  bool m_ReadChangeDue;
+  std::atomic<uint32_t> m_Serial;
+  std::atomic<uint32_t> m_LastTime;
+  unsigned int m_OverflowCount;
+};
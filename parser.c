@@ -27,6 +27,7 @@
 #include <vdr/remux.h>
 #include <vdr/channels.h>
 #include "config.h"
+#include "vnsi.h"
 #include "parser.h"
 #include "parser_AAC.h"
 #include "parser_AC3.h"
@@ -38,6 +39,9 @@
 #include "parser_Subtitle.h"
 #include "parser_Teletext.h"
 
+// frames in a row starting with a PES packet before scanning is skipped
+#define PES_ALIGNED_FRAMES 8
+
 #define PTS_MASK 0x1ffffffffLL
 //#define PTS_MASK 0x7ffffLL
 
@@ -72,6 +76,12 @@ void cParser::Reset()
   m_PesNextFramePtr = 0;
   m_FoundFrame = false;
   m_FrameValid = false;
+  m_PesAligned = false;
+  m_PesAlignedCount = 0;
+  m_PesFrameStep = 0;
+  m_PesStartPos = 0;
+  m_PesSkipPtr = -1;
+  m_PesSkipResumed = false;
   m_PesPacketLength = 0;
   m_PesHeaderPtr = 0;
   m_Error = ERROR_PES_GENERAL;
@@ -300,6 +310,7 @@ bool cParser::AddPESPacket(uint8_t *data, int size)
         return false;
       }
       m_PesHeaderPtr = 0;
+      m_PesStartPos = m_PesBufferPtr;
       m_IsPusi = false;
     }
     else if (!IsValidStartCode(data, size))
@@ -345,6 +356,7 @@ bool cParser::AddPESPacket(uint8_t *data, int size)
       }
       data += hdr_len;
       size -= hdr_len;
+      m_PesStartPos = m_PesBufferPtr;
       m_IsPusi = false;
     }
   }
@@ -361,15 +373,33 @@ bool cParser::AddPESPacket(uint8_t *data, int size)
     }
   }
 
+  // copy first packet of new frame to front, the finished frame does
+  // not take up space anymore
+  if (m_PesNextFramePtr)
+  {
+    memmove(m_PesBuffer, m_PesBuffer+m_PesNextFramePtr, m_PesBufferPtr-m_PesNextFramePtr);
+    m_PesBufferPtr = m_PesBufferPtr-m_PesNextFramePtr;
+    m_PesTimePos -= m_PesNextFramePtr;
+    m_PesStartPos -= m_PesNextFramePtr;
+    if (m_PesStartPos < 0)
+      m_PesStartPos = 0;
+    m_PesNextFramePtr = 0;
+  }
+
   if (m_PesBufferPtr + size >= m_PesBufferSize)
   {
-    if (m_PesBufferPtr + size >= 1000000)
+    size_t maxSize = (size_t)PesBufferMaxSize * 1024 * 1024;
+    if ((size_t)m_PesBufferPtr + size >= maxSize)
     {
-      ERRORLOG("cParser::AddPESPacket - max buffer size reached, pid: %d", m_pID);
+      ERRORLOG("cParser::AddPESPacket - max buffer size of %d MB reached, pid: %d", PesBufferMaxSize, m_pID);
       Reset();
       return false;
     }
-    m_PesBufferSize += m_PesBufferInitialSize / 10;
+    // grow geometrically, a large I-frame costs a few reallocs only
+    while (m_PesBufferPtr + size >= m_PesBufferSize)
+      m_PesBufferSize *= 2;
+    if ((size_t)m_PesBufferSize > maxSize)
+      m_PesBufferSize = maxSize;
     uint8_t *new_buffer = (uint8_t*)realloc(m_PesBuffer, m_PesBufferSize);
     if (new_buffer == NULL)
     {
@@ -381,15 +411,6 @@ bool cParser::AddPESPacket(uint8_t *data, int size)
     m_PesBuffer = new_buffer;
   }
 
-  // copy first packet of new frame to front
-  if (m_PesNextFramePtr)
-  {
-    memmove(m_PesBuffer, m_PesBuffer+m_PesNextFramePtr, m_PesBufferPtr-m_PesNextFramePtr);
-    m_PesBufferPtr = m_PesBufferPtr-m_PesNextFramePtr;
-    m_PesTimePos -= m_PesNextFramePtr;
-    m_PesNextFramePtr = 0;
-  }
-
   // copy payload
   memcpy(m_PesBuffer+m_PesBufferPtr, data, size);
   m_PesBufferPtr += size;
@@ -397,6 +418,107 @@ bool cParser::AddPESPacket(uint8_t *data, int size)
   return true;
 }
 
+/*
+ * PES-aligned fast path of the video parsers. Once the headers of a frame
+ * are parsed, the rest up to the next PES packet is not scanned for start
+ * codes. Scanning resumes at the next PES packet, which must start the
+ * next frame, otherwise what was skipped is scanned after all. A PES
+ * packet that carried a second frame is told by the timestamp of the next
+ * one: it must follow the skipped frame by less than two frame steps.
+ */
+bool cParser::SkipFrame(int p, uint32_t startcode)
+{
+  // only while still in the PES packet the frame started with
+  if (m_PesStartPos > 0)
+    return false;
+
+  m_PesSkipPtr = p;
+  m_PesSkipStartCode = startcode;
+  m_PesSkipDTS = m_curDTS;
+  m_PesSkipResumed = false;
+  return true;
+}
+
+// returns where scanning continues after a skipped frame, -1 if nothing
+// was skipped
+int cParser::SkipToNextPES()
+{
+  if (m_PesSkipPtr < 0 || m_PesSkipResumed)
+    return -1;
+
+  if (m_PesStartPos <= m_PesSkipPtr)
+    return m_PesBufferPtr;
+
+  m_PesSkipResumed = true;
+  return m_PesStartPos;
+}
+
+// called for the first start code after resuming, returns the position
+// to scan the skipped bytes again from if the frame did not end there
+int cParser::CheckResume(bool &complete, bool pending)
+{
+  if (!m_PesSkipResumed)
+    return -1;
+
+  // the next PES packet must start the frame after the skipped one, with
+  // a timestamp of its own. The step is measured against the shortest one
+  // between aligned frames, which is learned anew with the alignment, so a
+  // variable frame rate only ever lowers it. A PES packet that carried two
+  // frames puts the next one at least two steps on, while the longest
+  // regular step, 3:2 pulldown at 1.5, stays below 7/4. Field pictures in
+  // PES packets of their own step by a field, two fields in one packet
+  // break the alignment. A wrong guess costs a rescan, never a frame.
+  int64_t step = m_curDTS - m_PesSkipDTS;
+  bool next = m_PesTimePos == m_PesStartPos && m_PesSkipDTS != DVD_NOPTS_VALUE &&
+              step > 0 && step <= m_PesFrameStep * 7 / 4;
+
+  if (complete && (int)m_PesNextFramePtr <= m_PesStartPos + 4 && next)
+  {
+    m_PesSkipPtr = -1;
+    m_PesSkipResumed = false;
+    return -1;
+  }
+  if (pending && !complete)
+    return -1;
+
+  DEBUGLOG("pid %d: frames not PES aligned anymore", m_pID);
+  int p = m_PesSkipPtr;
+  complete = false;
+  m_PesSkipPtr = -1;
+  m_PesSkipResumed = false;
+  m_PesAligned = false;
+  m_PesAlignedCount = 0;
+  m_PesFrameStep = 0;
+  return p;
+}
+
+// called for every complete frame, learns if frames start with PES packets
+void cParser::CheckPESAligned()
+{
+  int start = m_PesNextFramePtr;
+  if (start >= m_PesStartPos && start <= m_PesStartPos + 4)
+  {
+    // shortest timestamp step between aligned frames
+    int64_t step = m_curDTS - m_prevDTS;
+    if (m_PesTimePos == m_PesStartPos && m_prevDTS != DVD_NOPTS_VALUE && step > 0 &&
+        (!m_PesFrameStep || step < m_PesFrameStep))
+      m_PesFrameStep = step;
+    if (!m_PesAligned && ++m_PesAlignedCount >= PES_ALIGNED_FRAMES)
+    {
+      DEBUGLOG("pid %d: frames are PES aligned", m_pID);
+      m_PesAligned = true;
+    }
+  }
+  else
+  {
+    m_PesAligned = false;
+    m_PesAlignedCount = 0;
+    m_PesFrameStep = 0;
+  }
+  m_PesSkipPtr = -1;
+  m_PesSkipResumed = false;
+}
+
 inline bool cParser::IsValidStartCode(uint8_t *buf, int size)
 {
   if (size < 4)
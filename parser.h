@@ -123,6 +123,7 @@ struct sStreamPacket
 
   uint8_t   commercial;
   uint8_t   componentindex;
+  uint8_t   frametype;      /* PKT_I_FRAME, PKT_P_FRAME, PKT_B_FRAME or 0 if unknown */
 
   uint8_t  *data;
   int       size;
@@ -161,6 +162,10 @@ public:
 
 protected:
   virtual bool IsValidStartCode(uint8_t *buf, int size);
+  bool SkipFrame(int p, uint32_t startcode);
+  int SkipToNextPES();
+  int CheckResume(bool &complete, bool pending);
+  void CheckPESAligned();
 
   uint8_t     m_PesHeader[PES_HEADER_LENGTH];
   int         m_PesHeaderPtr;
@@ -176,6 +181,17 @@ protected:
   bool        m_FoundFrame;
   bool        m_FrameValid;
 
+  // streams that start every frame with a PES packet are not scanned
+  // beyond the headers of a frame
+  bool        m_PesAligned;
+  int         m_PesAlignedCount;
+  int64_t     m_PesFrameStep;     // shortest DTS step between aligned frames, 0 if not known
+  int         m_PesStartPos;      // payload start of the latest PES packet
+  int         m_PesSkipPtr;       // scanning skipped from here, -1 if not
+  uint32_t    m_PesSkipStartCode;
+  int64_t     m_PesSkipDTS;       // DTS of the PES packet the skipped frame started with
+  bool        m_PesSkipResumed;   // at the next PES, checking it starts a frame
+
   int         m_pID;
   int64_t     m_curPTS;
   int64_t     m_curDTS;
@@ -24,6 +24,7 @@
 
 #include "parser_MPEGVideo.h"
 #include "bitstream.h"
+#include "startcode.h"
 #include "config.h"
 
 #include <stdlib.h>
@@ -79,16 +80,40 @@ void cParserMPEG2Video::Parse(sStreamPacket *pkt, sStreamPacket *pkt_side_data)
   int p = m_PesParserPtr;
   uint32_t startcode = m_StartCode;
   bool frameComplete = false;
-  int l;
-  while ((l = m_PesBufferPtr - p) > 3)
+  int resume = SkipToNextPES();
+  if (resume >= 0)
+  {
+    p = resume;
+    startcode = 0xffffffff;
+  }
+  while (m_PesBufferPtr - p > 3)
   {
     if ((startcode & 0xffffff00) == 0x00000100)
     {
-      if (Parse_MPEG2Video(startcode, p, frameComplete) < 0)
+      int ret = Parse_MPEG2Video(startcode, p, frameComplete);
+      resume = CheckResume(frameComplete, ret < 0);
+      if (resume >= 0)
+      {
+        p = resume;
+        startcode = m_PesSkipStartCode;
+        continue;
+      }
+      if (ret < 0)
       {
         break;
       }
+      // the rest of the picture is in this PES packet
+      if (m_PesAligned && m_FoundFrame && !m_NeedSPS && (startcode & 0xff) == 0 &&
+          SkipFrame(p + 1, startcode << 8 | m_PesBuffer[p]))
+      {
+        p = SkipToNextPES();
+        startcode = 0xffffffff;
+        continue;
+      }
     }
+    // start codes are handled with the byte following them
+    if ((startcode & 0x00ffffff) != 0x00000001)
+      p = FindStartCode(m_PesBuffer, p, m_PesBufferPtr - 4, startcode);
     startcode = startcode << 8 | m_PesBuffer[p++];
   }
   m_PesParserPtr = p;
@@ -96,6 +121,7 @@ void cParserMPEG2Video::Parse(sStreamPacket *pkt, sStreamPacket *pkt_side_data)
 
   if (frameComplete)
   {
+    CheckPESAligned();
     if (!m_NeedSPS && !m_NeedIFrame && m_FrameValid)
     {
       if (m_FpsScale == 0)
@@ -113,6 +139,7 @@ void cParserMPEG2Video::Parse(sStreamPacket *pkt, sStreamPacket *pkt_side_data)
       pkt->dts      = m_DTS;
       pkt->pts      = m_PTS;
       pkt->duration = m_FrameDuration;
+      pkt->frametype = m_FrameType;
       pkt->streamChange = streamChange;
     }
     m_StartCode = 0xffffffff;
@@ -128,6 +155,7 @@ void cParserMPEG2Video::Reset()
   m_StartCode = 0xffffffff;
   m_NeedIFrame = true;
   m_NeedSPS = true;
+  m_FrameType = 0;
 }
 
 int cParserMPEG2Video::Parse_MPEG2Video(uint32_t startcode, int buf_ptr, bool &complete)
@@ -272,6 +300,7 @@ bool cParserMPEG2Video::Parse_MPEG2Video_PicStart(uint8_t *buf)
 
   if (pct == PKT_I_FRAME)
     m_NeedIFrame = false;
+  m_FrameType = pct;
 
   int vbvDelay = bs.readBits(16); /* vbv_delay */
   if (vbvDelay  == 0xffff)
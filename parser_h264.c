@@ -24,6 +24,7 @@
 
 #include "parser_h264.h"
 #include "bitstream.h"
+#include "startcode.h"
 #include "config.h"
 
 #include <stdlib.h>
@@ -80,16 +81,41 @@ void cParserH264::Parse(sStreamPacket *pkt, sStreamPacket *pkt_side_data)
   int p = m_PesParserPtr;
   uint32_t startcode = m_StartCode;
   bool frameComplete = false;
-  int l;
-  while ((l = m_PesBufferPtr - p) > 3)
+  int resume = SkipToNextPES();
+  if (resume >= 0)
+  {
+    p = resume;
+    startcode = 0xffffffff;
+  }
+  while (m_PesBufferPtr - p > 3)
   {
     if ((startcode & 0xffffff00) == 0x00000100)
     {
-      if (Parse_H264(startcode, p, frameComplete) < 0)
+      int ret = Parse_H264(startcode, p, frameComplete);
+      resume = CheckResume(frameComplete, ret < 0);
+      if (resume >= 0)
+      {
+        p = resume;
+        startcode = m_PesSkipStartCode;
+        continue;
+      }
+      if (ret < 0)
       {
         break;
       }
+      // the rest of the frame is in this PES packet
+      int nal = startcode & 0x1f;
+      if (m_PesAligned && m_FoundFrame && !m_NeedSPS && !m_NeedPPS && nal >= 1 && nal <= 5 &&
+          SkipFrame(p + 1, startcode << 8 | m_PesBuffer[p]))
+      {
+        p = SkipToNextPES();
+        startcode = 0xffffffff;
+        continue;
+      }
     }
+    // start codes are handled with the byte following them
+    if ((startcode & 0x00ffffff) != 0x00000001)
+      p = FindStartCode(m_PesBuffer, p, m_PesBufferPtr - 4, startcode);
     startcode = startcode << 8 | m_PesBuffer[p++];
   }
   m_PesParserPtr = p;
@@ -97,6 +123,7 @@ void cParserH264::Parse(sStreamPacket *pkt, sStreamPacket *pkt_side_data)
 
   if (frameComplete)
   {
+    CheckPESAligned();
     if (!m_NeedSPS && !m_NeedIFrame && m_FrameValid)
     {
       double PAR = (double)m_PixelAspect.num/(double)m_PixelAspect.den;
@@ -123,6 +150,7 @@ void cParserH264::Parse(sStreamPacket *pkt, sStreamPacket *pkt_side_data)
       pkt->dts      = m_DTS;
       pkt->pts      = m_PTS;
       pkt->duration = duration;
+      pkt->frametype = m_FrameType;
       pkt->streamChange = streamChange;
     }
     m_StartCode = 0xffffffff;
@@ -139,6 +167,8 @@ void cParserH264::Reset()
   m_NeedIFrame = true;
   m_NeedSPS = true;
   m_NeedPPS = true;
+  m_SliceType = 0;
+  m_FrameType = 0;
   memset(&m_streamData, 0, sizeof(m_streamData));
 }
 
@@ -176,6 +206,7 @@ int cParserH264::Parse_H264(uint32_t startcode, int buf_ptr, bool &complete)
 
     if (!m_FoundFrame)
     {
+      m_FrameType = m_SliceType;
       if (buf_ptr - 4 >= m_PesTimePos)
       {
         m_DTS = m_curDTS;
@@ -296,11 +327,14 @@ bool cParserH264::Parse_SLH(uint8_t *buf, int len, h264_private::VCL_NAL &vcl)
   switch (slice_type)
   {
   case 0:
+    m_SliceType = PKT_P_FRAME;
     break;
   case 1:
+    m_SliceType = PKT_B_FRAME;
     break;
   case 2:
     m_NeedIFrame = false;
+    m_SliceType = PKT_I_FRAME;
     break;
   default:
     return false;
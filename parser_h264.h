@@ -101,6 +101,8 @@ private:
   int             m_vbvSize;        /* Video buffer size (in bytes) */
   int64_t         m_DTS;
   int64_t         m_PTS;
+  uint8_t         m_SliceType;
+  uint8_t         m_FrameType;
 
   int Parse_H264(uint32_t startcode, int buf_ptr, bool &complete);
   bool Parse_PPS(uint8_t *buf, int len);
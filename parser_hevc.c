@@ -27,11 +27,14 @@
 
 #include "parser_hevc.h"
 #include "bitstream.h"
+#include "startcode.h"
 #include "config.h"
 
 #include <stdlib.h>
 #include <assert.h>
 
+// bytes of a slice NAL enough to parse its header
+#define HEVC_SLICE_HEADER_SIZE 32
 
 cParserHEVC::cParserHEVC(int pID, cTSStream *stream, sPtsWrap *ptsWrap, bool observePtsWraps)
  : cParser(pID, stream, ptsWrap, observePtsWraps)
@@ -61,16 +64,61 @@ void cParserHEVC::Parse(sStreamPacket *pkt, sStreamPacket *pkt_side_data)
   uint32_t startcode = m_StartCode;
   bool frameComplete = false;
 
+  int resume = SkipToNextPES();
+  if (resume >= 0)
+  {
+    p = resume;
+    startcode = 0xffffffff;
+  }
+  else if (m_LastStartPos != -1 && ParseSliceHeader(m_LastStartPos))
+  {
+    m_LastStartPos = -1;
+    if (SkipFrame(p, startcode))
+    {
+      p = SkipToNextPES();
+      startcode = 0xffffffff;
+    }
+  }
   while (m_PesBufferPtr - p)
   {
-    startcode = startcode << 8 | m_PesBuffer[p++];
+    p = FindStartCode(m_PesBuffer, p, m_PesBufferPtr, startcode);
     if ((startcode & 0x00ffffff) == 0x00000001)
     {
+      bool skip = false;
       if (m_LastStartPos != -1)
-         Parse_HEVC(m_LastStartPos, p-m_LastStartPos, &frameComplete);
+      {
+        Parse_HEVC(m_LastStartPos, p-m_LastStartPos, &frameComplete);
+        resume = CheckResume(frameComplete, false);
+        if (resume >= 0)
+        {
+          p = resume;
+          startcode = m_PesSkipStartCode;
+          m_LastStartPos = -1;
+          continue;
+        }
+        skip = m_PesAligned && m_FoundFrame && !m_NeedSPS && !m_NeedPPS &&
+               IsVclNal(m_PesBuffer[m_LastStartPos]);
+      }
       m_LastStartPos = p;
       if (frameComplete)
         break;
+      // the rest of the frame is in this PES packet, scanning goes back
+      // to this start code if the next PES does not start a frame
+      if (skip && SkipFrame(p-3, 0xffffffff))
+      {
+        p = SkipToNextPES();
+        startcode = 0xffffffff;
+        m_LastStartPos = -1;
+      }
+      else if (ParseSliceHeader(p))
+      {
+        m_LastStartPos = -1;
+        if (SkipFrame(p, startcode))
+        {
+          p = SkipToNextPES();
+          startcode = 0xffffffff;
+        }
+      }
     }
   }
   m_PesParserPtr = p;
@@ -78,6 +126,7 @@ void cParserHEVC::Parse(sStreamPacket *pkt, sStreamPacket *pkt_side_data)
 
   if (frameComplete)
   {
+    CheckPESAligned();
     if (!m_NeedSPS && m_FrameValid)
     {
       double PAR = (double)m_PixelAspect.num/(double)m_PixelAspect.den;
@@ -102,6 +151,7 @@ void cParserHEVC::Parse(sStreamPacket *pkt, sStreamPacket *pkt_side_data)
       pkt->dts      = m_DTS;
       pkt->pts      = m_PTS;
       pkt->duration = duration;
+      pkt->frametype = m_FrameType;
       pkt->streamChange = streamChange;
 
     }
@@ -120,10 +170,31 @@ void cParserHEVC::Reset()
   m_LastStartPos = -1;
   m_NeedSPS = true;
   m_NeedPPS = true;
+  m_FrameType = 0;
   memset(&m_streamData, 0, sizeof(m_streamData));
 }
 
 
+bool cParserHEVC::IsVclNal(uint8_t header)
+{
+  int nal = (header >> 1) & 0x3f;
+  return nal <= NAL_RASL_R || (nal >= NAL_BLA_W_LP && nal <= NAL_CRA_NUT);
+}
+
+// with PES aligned frames the first slice of a frame is parsed as soon as
+// its header is in, returns true if the NAL at pos has been parsed
+bool cParserHEVC::ParseSliceHeader(int pos)
+{
+  if (!m_PesAligned || m_FoundFrame || m_NeedSPS || m_NeedPPS)
+    return false;
+  if (m_PesBufferPtr - pos < HEVC_SLICE_HEADER_SIZE || !IsVclNal(m_PesBuffer[pos]))
+    return false;
+
+  bool complete = false;
+  Parse_HEVC(pos, m_PesBufferPtr - pos, &complete);
+  return true;
+}
+
 void cParserHEVC::Parse_HEVC(int buf_ptr, unsigned int NumBytesInNalUnit, bool *complete)
 {
   uint8_t *buf = m_PesBuffer + buf_ptr;
@@ -162,6 +233,11 @@ void cParserHEVC::Parse_HEVC(int buf_ptr, unsigned int NumBytesInNalUnit, bool *
 
     if (!m_FoundFrame)
     {
+      // only random access points are told apart
+      if (hdr.nal_unit_type >= NAL_BLA_W_LP && hdr.nal_unit_type <= NAL_CRA_NUT)
+        m_FrameType = PKT_I_FRAME;
+      else
+        m_FrameType = 0;
       if (buf_ptr - 3 >= m_PesTimePos)
       {
         m_DTS = m_curDTS;
@@ -104,12 +104,15 @@ private:
   hevc_private    m_streamData;
   int64_t         m_DTS;
   int64_t         m_PTS;
+  uint8_t         m_FrameType;
 
   void Parse_HEVC(int buf_ptr, unsigned int NumBytesInNalUnit, bool *complete);
   void Parse_PPS(uint8_t *buf, int len);
   void Parse_SLH(uint8_t *buf, int len, HDR_NAL hdr, hevc_private::VCL_NAL &vcl);
   void Parse_SPS(uint8_t *buf, int len, HDR_NAL hdr);
   bool IsFirstVclNal(hevc_private::VCL_NAL &vcl);
+  bool IsVclNal(uint8_t header);
+  bool ParseSliceHeader(int pos);
 
 public:
   cParserHEVC(int pID, cTSStream *stream, sPtsWrap *ptsWrap, bool observePtsWraps);
@@ -29,6 +29,7 @@
  */
 
 #include "recplayer.h"
+#include "iopriority.h"
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -231,7 +232,9 @@ int cRecPlayer::getBlock(unsigned char* buffer, uint64_t position, int amount)
   }
 
   // try to read the block
+  uint64_t start = cIOPriority::Now();
   int bytes_read = read(m_file, buffer, amount);
+  cIOPriority::Account(IOCLASS_PLAYBACK, bytes_read, start);
 
   // we may got stuck at end of segment
   if ((bytes_read == 0) && (position < m_totalLength))
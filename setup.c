@@ -29,28 +29,53 @@ int PmtTimeout = 0;
 int TimeshiftMode = 0;
 int TimeshiftBufferSize = 5;
 int TimeshiftBufferFileSize = 6;
+int TimeshiftMemoryBudget = 0;
+int TimeshiftShared = 0;
 char TimeshiftBufferDir[PATH_MAX] = "\0";
+int TimeshiftBufferDirectIO = 0;
+int TimeshiftRAMSeconds = 30;
 int PlayRecording = 0;
 int AvoidEPGScan = 1;
 int DisableScrambleTimeout = 0;
+int BackZapChannels = 0;
+int BackZapGraceTime = 60;
+int PacingLead = 0;
+int LiveBufferSeconds = 3;
+int TimeshiftOnDemand = 0;
+int ResumeGraceTime = 30;
+int PesBufferMaxSize = 8;
 
 cMenuSetupVNSI::cMenuSetupVNSI(void)
 {
   timeshiftModesTexts[0] = tr("Off");
   timeshiftModesTexts[1] = tr("RAM");
   timeshiftModesTexts[2] = tr("File");
+  timeshiftModesTexts[3] = tr("RAM+File");
+  timeshiftModesTexts[4] = tr("RAM, demuxed");
   newTimeshiftMode = TimeshiftMode;
-  Add(new cMenuEditStraItem( tr("Time Shift Mode"), &newTimeshiftMode, 3, timeshiftModesTexts));
+  Add(new cMenuEditStraItem( tr("Time Shift Mode"), &newTimeshiftMode, 5, timeshiftModesTexts));
 
   newTimeshiftBufferSize = TimeshiftBufferSize;
   Add(new cMenuEditIntItem( tr("TS Buffersize (RAM) (1-80) x 100MB"), &newTimeshiftBufferSize));
 
+  newTimeshiftMemoryBudget = TimeshiftMemoryBudget;
+  Add(new cMenuEditIntItem( tr("TS RAM for all clients (0=unlimited) x 100MB"), &newTimeshiftMemoryBudget));
+
+  newTimeshiftShared = TimeshiftShared;
+  Add(new cMenuEditBoolItem( tr("Share TS Buffer (RAM) between clients"), &newTimeshiftShared));
+
   newTimeshiftBufferFileSize = TimeshiftBufferFileSize;
   Add(new cMenuEditIntItem( tr("TS Buffersize (File) (1-10) x 1GB"), &newTimeshiftBufferFileSize));
 
   strn0cpy(newTimeshiftBufferDir, TimeshiftBufferDir, sizeof(newTimeshiftBufferDir));
   Add(new cMenuEditStrItem(tr("TS Buffer Directory"), newTimeshiftBufferDir, sizeof(newTimeshiftBufferDir)));
 
+  newTimeshiftBufferDirectIO = TimeshiftBufferDirectIO;
+  Add(new cMenuEditBoolItem( tr("TS Buffer (File) direct I/O"), &newTimeshiftBufferDirectIO));
+
+  newTimeshiftRAMSeconds = TimeshiftRAMSeconds;
+  Add(new cMenuEditIntItem( tr("TS RAM part of RAM+File (1-600) seconds"), &newTimeshiftRAMSeconds));
+
   newPlayRecording = PlayRecording;
   Add(new cMenuEditBoolItem( tr("Play Recording instead of live"), &newPlayRecording));
 
@@ -59,6 +84,27 @@ cMenuSetupVNSI::cMenuSetupVNSI(void)
 
   newDisableScrambleTimeout = DisableScrambleTimeout;
   Add(new cMenuEditBoolItem( tr("Disable scramble timeout"), &newDisableScrambleTimeout));
+
+  newBackZapChannels = BackZapChannels;
+  Add(new cMenuEditIntItem( tr("Channels kept for back-zap (0-4)"), &newBackZapChannels));
+
+  newBackZapGraceTime = BackZapGraceTime;
+  Add(new cMenuEditIntItem( tr("Keep back-zap channels (5-600) seconds"), &newBackZapGraceTime));
+
+  newPacingLead = PacingLead;
+  Add(new cMenuEditIntItem( tr("Pace timeshift playback, lead (0=off) seconds"), &newPacingLead));
+
+  newLiveBufferSeconds = LiveBufferSeconds;
+  Add(new cMenuEditIntItem( tr("Live buffer without time shift (1-10) seconds"), &newLiveBufferSeconds));
+
+  newTimeshiftOnDemand = TimeshiftOnDemand;
+  Add(new cMenuEditBoolItem( tr("Start time shift on pause"), &newTimeshiftOnDemand));
+
+  newResumeGraceTime = ResumeGraceTime;
+  Add(new cMenuEditIntItem( tr("Keep streams for reconnecting clients (0-600) seconds"), &newResumeGraceTime));
+
+  newPesBufferMaxSize = PesBufferMaxSize;
+  Add(new cMenuEditIntItem( tr("Max. PES buffer size per stream (1-64) MB"), &newPesBufferMaxSize));
 }
 
 void cMenuSetupVNSI::Store(void)
@@ -75,6 +121,14 @@ void cMenuSetupVNSI::Store(void)
     newTimeshiftBufferSize = 1;
   SetupStore(CONFNAME_TIMESHIFTBUFFERSIZE, TimeshiftBufferSize = newTimeshiftBufferSize);
 
+  if (newTimeshiftMemoryBudget > 800)
+    newTimeshiftMemoryBudget = 800;
+  else if (newTimeshiftMemoryBudget < 0)
+    newTimeshiftMemoryBudget = 0;
+  SetupStore(CONFNAME_TIMESHIFTMEMORYBUDGET, TimeshiftMemoryBudget = newTimeshiftMemoryBudget);
+
+  SetupStore(CONFNAME_TIMESHIFTSHARED, TimeshiftShared = newTimeshiftShared);
+
   if (newTimeshiftBufferFileSize > 20)
     newTimeshiftBufferFileSize = 20;
   else if (newTimeshiftBufferFileSize < 1)
@@ -83,9 +137,55 @@ void cMenuSetupVNSI::Store(void)
 
   SetupStore(CONFNAME_TIMESHIFTBUFFERDIR, strn0cpy(TimeshiftBufferDir, newTimeshiftBufferDir, sizeof(TimeshiftBufferDir)));
 
+  SetupStore(CONFNAME_TIMESHIFTBUFFERDIRECTIO, TimeshiftBufferDirectIO = newTimeshiftBufferDirectIO);
+
+  if (newTimeshiftRAMSeconds > 600)
+    newTimeshiftRAMSeconds = 600;
+  else if (newTimeshiftRAMSeconds < 1)
+    newTimeshiftRAMSeconds = 1;
+  SetupStore(CONFNAME_TIMESHIFTRAMSECONDS, TimeshiftRAMSeconds = newTimeshiftRAMSeconds);
+
   SetupStore(CONFNAME_PLAYRECORDING, PlayRecording = newPlayRecording);
 
   SetupStore(CONFNAME_AVOIDEPGSCAN, AvoidEPGScan = newAvoidEPGScan);
 
   SetupStore(CONFNAME_DISABLESCRAMBLETIMEOUT, DisableScrambleTimeout = newDisableScrambleTimeout);
+
+  if (newBackZapChannels > 4)
+    newBackZapChannels = 4;
+  else if (newBackZapChannels < 0)
+    newBackZapChannels = 0;
+  SetupStore(CONFNAME_BACKZAPCHANNELS, BackZapChannels = newBackZapChannels);
+
+  if (newBackZapGraceTime > 600)
+    newBackZapGraceTime = 600;
+  else if (newBackZapGraceTime < 5)
+    newBackZapGraceTime = 5;
+  SetupStore(CONFNAME_BACKZAPGRACETIME, BackZapGraceTime = newBackZapGraceTime);
+
+  if (newPacingLead > 30)
+    newPacingLead = 30;
+  else if (newPacingLead < 0)
+    newPacingLead = 0;
+  SetupStore(CONFNAME_PACINGLEAD, PacingLead = newPacingLead);
+
+  if (newLiveBufferSeconds > 10)
+    newLiveBufferSeconds = 10;
+  else if (newLiveBufferSeconds < 1)
+    newLiveBufferSeconds = 1;
+  SetupStore(CONFNAME_LIVEBUFFERSECONDS, LiveBufferSeconds = newLiveBufferSeconds);
+
+  SetupStore(CONFNAME_TIMESHIFTONDEMAND, TimeshiftOnDemand = newTimeshiftOnDemand);
+
+  if (newResumeGraceTime > 600)
+    newResumeGraceTime = 600;
+  else if (newResumeGraceTime < 0)
+    newResumeGraceTime = 0;
+  SetupStore(CONFNAME_RESUMEGRACETIME, ResumeGraceTime = newResumeGraceTime);
+
+  if (newPesBufferMaxSize > 64)
+    newPesBufferMaxSize = 64;
+  else if (newPesBufferMaxSize < 1)
+    newPesBufferMaxSize = 1;
+  SetupStore(CONFNAME_PESBUFFERMAXSIZE, PesBufferMaxSize = newPesBufferMaxSize);
 }
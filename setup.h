@@ -32,13 +32,24 @@ class cMenuSetupVNSI : public cMenuSetupPage
 private:
   int newPmtTimeout;
   int newTimeshiftMode;
-  const char *timeshiftModesTexts[3];
+  const char *timeshiftModesTexts[5];
   int newTimeshiftBufferSize;
+  int newTimeshiftMemoryBudget;
+  int newTimeshiftShared;
   int newTimeshiftBufferFileSize;
   char newTimeshiftBufferDir[PATH_MAX];
+  int newTimeshiftBufferDirectIO;
+  int newTimeshiftRAMSeconds;
   int newPlayRecording;
   int newAvoidEPGScan;
   int newDisableScrambleTimeout;
+  int newBackZapChannels;
+  int newBackZapGraceTime;
+  int newPacingLead;
+  int newLiveBufferSeconds;
+  int newTimeshiftOnDemand;
+  int newResumeGraceTime;
+  int newPesBufferMaxSize;
 protected:
   virtual void Store(void);
 public:
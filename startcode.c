@@ -0,0 +1,94 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "startcode.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static inline uint32_t ReadBE32(const uint8_t *buf)
+{
+  return (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+int FindStartCode(const uint8_t *buf, int p, int end, uint32_t &startcode)
+{
+  // nothing to scan, startcode stays as it is
+  if (p >= end)
+    return p;
+
+  // a start code may have begun in the bytes scanned before
+  int start = p;
+  while (p < end && p < start + 3)
+  {
+    startcode = startcode << 8 | buf[p++];
+    if ((startcode & 0x00ffffff) == 0x00000001)
+      return p;
+  }
+  if (p == end)
+    return end;
+
+  // from here on a start code is all in buf, p is where its 01 may be
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  for (; p + 16 <= end; p += 16)
+  {
+    // most blocks do not have a single zero byte
+    __m128i zeros1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + p - 1)), zero);
+    if (!_mm_movemask_epi8(zeros1))
+      continue;
+
+    __m128i zeros2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + p - 2)), zero);
+    __m128i ones = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + p)), one);
+    int mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(zeros1, zeros2), ones));
+    if (mask)
+    {
+      p += __builtin_ctz(mask);
+      startcode = ReadBE32(buf + p - 3);
+      return p + 1;
+    }
+  }
+#endif
+
+  while (p < end)
+  {
+    // skip what cannot be the 01 of a start code or its zeros
+    if (buf[p] > 1)
+      p += 3;
+    else if (buf[p-1])
+      p += 2;
+    else if (buf[p-2] || buf[p] != 1)
+      p++;
+    else
+    {
+      startcode = ReadBE32(buf + p - 3);
+      return p + 1;
+    }
+  }
+  startcode = ReadBE32(buf + end - 4);
+  return end;
+}
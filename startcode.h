@@ -0,0 +1,37 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+
+/*!
+ * Scans buf from p to end for the next 00 00 01 start code prefix, like
+ * shifting one byte after the other into startcode, which carries the
+ * last bytes scanned from one call to the next. Returns the position
+ * after the 01, or end if there is none. If p is not before end, p is
+ * returned and startcode is left untouched.
+ */
+int FindStartCode(const uint8_t *buf, int p, int end, uint32_t &startcode);
@@ -37,10 +37,48 @@
 #include "responsepacket.h"
 #include "vnsi.h"
 #include "videobuffer.h"
+#include "packetbuffer.h"
+#include "iopriority.h"
+
+// --- cStreamSender -------------------------------------------------
+
+// sends what the stream thread stored in a post-demux timeshift buffer
+class cStreamSender : public cThread
+{
+public:
+  cStreamSender(cLiveStreamer *streamer);
+  virtual ~cStreamSender();
+  void Stop() { Cancel(5); }
+
+protected:
+  virtual void Action(void);
+  cLiveStreamer *m_Streamer;
+};
+
+cStreamSender::cStreamSender(cLiveStreamer *streamer)
+  :cThread("VNSI stream sender")
+{
+  m_Streamer = streamer;
+}
+
+cStreamSender::~cStreamSender()
+{
+  Cancel(5);
+}
+
+void cStreamSender::Action(void)
+{
+  while (Running())
+    m_Streamer->sendStored();
+}
 
 
 // --- cLiveStreamer -------------------------------------------------
 
+std::list<cLiveStreamer*> cLiveStreamer::m_BackZap;
+std::list<cLiveStreamer*> cLiveStreamer::m_Sessions;
+cMutex cLiveStreamer::m_BackZapMutex;
+
 cLiveStreamer::cLiveStreamer(int clientID, bool bAllowRDS, uint8_t timeshift, uint32_t timeout)
  : cThread("cLiveStreamer stream processor")
  , m_ClientID(clientID)
@@ -57,8 +95,23 @@ cLiveStreamer::cLiveStreamer(int clientID, bool bAllowRDS, uint8_t timeshift, ui
   m_SignalLost      = false;
   m_IFrameSeen      = false;
   m_VideoBuffer     = NULL;
+  m_PacketBuffer    = NULL;
+  m_Sender          = NULL;
   m_Timeshift       = timeshift;
   m_IsRetune        = false;
+  m_Parked          = false;
+  m_Sending         = true;
+  m_Resume          = false;
+  m_Expired         = false;
+  m_Token           = 0;
+  m_ResumeTime      = DVD_NOPTS_VALUE;
+  m_PaceDts         = DVD_NOPTS_VALUE;
+  m_PaceLastDts     = DVD_NOPTS_VALUE;
+  m_PaceStart       = 0;
+  m_PaceBytes       = 0;
+  m_PaceSerial      = 0;
+  m_PacingRate      = 0;
+  m_PaceBehind      = false;
 
   memset(&m_FrontendInfo, 0, sizeof(m_FrontendInfo));
 
@@ -95,8 +148,11 @@ bool cLiveStreamer::Open(int serial)
     recording = true;
     m_VideoBuffer = cVideoBuffer::Create(VNSIServerConfig.testStreamFile);
   }
-  else if (PlayRecording && serial == -1)
+  else if ((PlayRecording && serial == -1) || (TimeshiftMode && m_Timeshift))
   {
+    // with timeshift requested, a running recording of the channel serves
+    // as the buffer, starting at its live edge
+    bool live = !(PlayRecording && serial == -1);
 #if VDRVERSNUM >= 20301
     LOCK_TIMERS_READ;
     for (const cTimer *timer = Timers->First(); timer; timer = Timers->Next(timer))
@@ -117,6 +173,8 @@ bool cLiveStreamer::Open(int serial)
           rec = Recordings->GetByName(matchRec.FileName());
           if (!rec)
           {
+            if (live)
+              break;
             return false;
           }
         }
@@ -129,19 +187,30 @@ bool cLiveStreamer::Open(int serial)
           rec = Recordings.GetByName(matchRec.FileName());
           if (!rec)
           {
+            if (live)
+              break;
             return false;
           }
         }
 #endif
-        m_VideoBuffer = cVideoBuffer::Create(rec);
-        recording = true;
+        m_VideoBuffer = cVideoBuffer::Create(rec, live);
+        recording = m_VideoBuffer != NULL;
         break;
       }
     }
   }
   if (!recording)
   {
-    m_VideoBuffer = cVideoBuffer::Create(m_ClientID, m_Timeshift);
+    m_VideoBuffer = cVideoBuffer::Create(m_ClientID, m_Timeshift, m_Channel);
+
+    // time shift after the demuxer, the TS side is only a live ring
+    if (m_VideoBuffer && TimeshiftMode == 4 && m_Timeshift)
+    {
+      m_PacketBuffer = cPacketBuffer::Create();
+      if (!m_PacketBuffer)
+        return false;
+      m_Sender = new cStreamSender(this);
+    }
   }
 
   if (!m_VideoBuffer)
@@ -152,8 +221,9 @@ bool cLiveStreamer::Open(int serial)
     if (m_Channel && ((m_Channel->Source() >> 24) == 'V'))
       m_IsMPEGPS = true;
 
+    // a shared buffer may already be fed by another client
     m_IsRetune = false;
-    if (!m_VideoInput.Open(m_Channel, m_Priority, m_VideoBuffer))
+    if (m_VideoBuffer->WantsInput() && !m_VideoInput.Open(m_Channel, m_Priority, m_VideoBuffer))
     {
       ERRORLOG("Can't switch to channel %i - %s", m_Channel->Number(), m_Channel->Name());
       return false;
@@ -171,9 +241,25 @@ void cLiveStreamer::Close(void)
 {
   INFOLOG("LiveStreamer::Close - close");
   m_VideoInput.Close();
+  if (m_Sender)
+  {
+    delete m_Sender;
+    m_Sender = NULL;
+  }
+  if (m_PacketBuffer)
+  {
+    if (m_PacketBuffer->GetOverflowCount())
+      INFOLOG("LiveStreamer::Close - packet buffer overflows: %u", m_PacketBuffer->GetOverflowCount());
+    delete m_PacketBuffer;
+    m_PacketBuffer = NULL;
+  }
   m_Demuxer.Close();
   if (m_VideoBuffer)
   {
+    if (m_VideoBuffer->GetResyncCount())
+      INFOLOG("LiveStreamer::Close - TS resync events: %u", m_VideoBuffer->GetResyncCount());
+    if (m_VideoBuffer->GetOverflowCount())
+      INFOLOG("LiveStreamer::Close - buffer overflows: %u", m_VideoBuffer->GetOverflowCount());
     delete m_VideoBuffer;
     m_VideoBuffer = NULL;
   }
@@ -188,54 +274,125 @@ void cLiveStreamer::Close(void)
 void cLiveStreamer::Action(void)
 {
   int ret;
-  sStreamPacket pkt_data;
-  sStreamPacket pkt_side_data; // Additional data
-  memset(&pkt_data, 0, sizeof(sStreamPacket));
-  memset(&pkt_side_data, 0, sizeof(sStreamPacket));
+  sStreamPacket pkt_data[DEMUX_BATCH_SIZE];
+  sStreamPacket pkt_side_data[DEMUX_BATCH_SIZE]; // Additional data
+  memset(pkt_data, 0, sizeof(pkt_data));
+  memset(pkt_side_data, 0, sizeof(pkt_side_data));
   bool requestStreamChangeData = false;
   bool requestStreamChangeSideData = false;
   cTimeMs last_info(1000);
   cTimeMs bufferStatsTimer(1000);
+  bool sending = true;
+
+  // timeshift reads are what the client waits for
+  cIOPriority::Set(IOCLASS_PLAYBACK);
+
+  if (m_Sender)
+    m_Sender->Start();
 
   while (Running())
   {
-    if (m_IsRetune)
-      ret = -1;
-    else
-      ret = m_Demuxer.Read(&pkt_data, &pkt_side_data);
-    if (ret > 0)
+    // parked for back-zap, keep demuxing but send nothing
     {
-      if (pkt_data.pmtChange)
+      cMutexLock lock(&m_Mutex);
+      if (m_Resume)
       {
+        // a reconnected client continues where it left off if that is
+        // still buffered, otherwise from the latest keyframe
+        uint32_t serial;
+        if (m_ResumeTime == DVD_NOPTS_VALUE || !SeekTime(m_ResumeTime, serial))
+        {
+          if (m_PacketBuffer)
+            m_PacketBuffer->Resume();
+          else
+            m_Demuxer.Resume();
+        }
+        m_ResumeTime = DVD_NOPTS_VALUE;
+        m_Resume = false;
+        ResetPacing();
         requestStreamChangeData = true;
         requestStreamChangeSideData = true;
+        m_last_tick.Set(0);
       }
+      if (m_Parked && m_ParkTimer.TimedOut())
+      {
+        INFOLOG("parked channel %s expired", m_Channel->Name());
+        break;
+      }
+      if (m_Sending == m_Parked)
+      {
+        // stored packets go out from their own thread
+        if (m_Sender && m_Parked)
+          m_Sender->Stop();
+        else if (m_Sender)
+          m_Sender->Start();
+        m_Sending = !m_Parked;
+        m_Event.Broadcast();
+      }
+      sending = m_Sending;
+    }
 
-      // Process normal data if present
-      if (pkt_data.data)
+    // far enough ahead of the client's playback, let it catch up
+    int delay = sending && !m_PacketBuffer ? PacingDelay() : 0;
+    if (delay > 0)
+    {
+      cCondWait::SleepMs(delay < 100 ? delay : 100);
+      continue;
+    }
+
+    if (m_IsRetune)
+      ret = -1;
+    else
+      ret = m_Demuxer.Read(pkt_data, pkt_side_data, DEMUX_BATCH_SIZE);
+    if (ret > 0 && !sending && !m_PacketBuffer)
+      continue;
+    if (ret > 0)
+    {
+      for (int i = 0; i < ret; i++)
       {
-        if (pkt_data.streamChange || requestStreamChangeData)
-          sendStreamChange();
-        requestStreamChangeData = false;
-        if (pkt_data.reftime)
+        if (pkt_data[i].pmtChange)
         {
-          sendRefTime(&pkt_data);
-          pkt_data.reftime = 0;
+          requestStreamChangeData = true;
+          requestStreamChangeSideData = true;
         }
-        sendStreamPacket(&pkt_data);
-      }
 
-      // If some additional data is present inside the stream, it is written there (currently RDS inside MPEG2-Audio)
-      if (pkt_side_data.data)
-      {
-        if (pkt_side_data.streamChange || requestStreamChangeSideData)
-          sendStreamChange();
-        requestStreamChangeSideData = false;
+        if (m_PacketBuffer)
+        {
+          storePacket(&pkt_data[i], &pkt_side_data[i], requestStreamChangeData, requestStreamChangeSideData);
+          continue;
+        }
 
-        sendStreamPacket(&pkt_side_data);
-        pkt_side_data.data = NULL;
+        // Process normal data if present
+        if (pkt_data[i].data)
+        {
+          if (pkt_data[i].streamChange || requestStreamChangeData)
+            sendStreamChange();
+          requestStreamChangeData = false;
+          if (pkt_data[i].reftime)
+          {
+            sendRefTime(&pkt_data[i]);
+            pkt_data[i].reftime = 0;
+          }
+          sendStreamPacket(&pkt_data[i]);
+          Pace(&pkt_data[i]);
+        }
+
+        // If some additional data is present inside the stream, it is written there (currently RDS inside MPEG2-Audio)
+        if (pkt_side_data[i].data)
+        {
+          if (pkt_side_data[i].streamChange || requestStreamChangeSideData)
+            sendStreamChange();
+          requestStreamChangeSideData = false;
+
+          sendStreamPacket(&pkt_side_data[i]);
+          pkt_side_data[i].data = NULL;
+        }
       }
 
+      // a parked stream keeps filling its timeshift buffer
+      if (!sending)
+        continue;
+
       // send signal info every 10 sec.
       if(last_info.TimedOut())
       {
@@ -259,16 +416,32 @@ void cLiveStreamer::Action(void)
     }
     else if (ret == -1)
     {
-      // no data
+      // the demuxer ran dry, the client is at the live edge
+      if (sending && !m_PacketBuffer)
+        ResetPacing();
+
       {
         bool retune = false;
         {
           cMutexLock lock(&m_Mutex);
           retune = m_IsRetune;
-          if (!retune)
-            m_Event.TimedWait(m_Mutex, 10);
         }
 
+        // sleep until the input has put a batch of data, or a retune,
+        // the receiver is asked to commit staged data once it is stale
+        if (!retune)
+        {
+          int timeout = m_VideoInput.FlushStale(100);
+          if (timeout)
+            m_VideoBuffer->WaitForData(timeout);
+          cMutexLock lock(&m_Mutex);
+          retune = m_IsRetune;
+        }
+
+        // took over feeding a shared buffer
+        if (!m_VideoInput.IsOpen() && m_VideoBuffer->WantsInput())
+          retune = true;
+
         if (m_Demuxer.GetError() & ERROR_CAM_ERROR)
         {
           INFOLOG("CAM error, try reset");
@@ -293,7 +466,7 @@ void cLiveStreamer::Action(void)
           }
         }
       }
-      if(m_last_tick.Elapsed() >= (uint64_t)(m_scanTimeout*1000))
+      if(sending && m_last_tick.Elapsed() >= (uint64_t)(m_scanTimeout*1000))
       {
         sendStreamStatus();
         m_last_tick.Set(0);
@@ -304,15 +477,28 @@ void cLiveStreamer::Action(void)
     {
       if (!Open(m_Demuxer.GetSerial()))
       {
-        m_Socket->Shutdown();
+        if (sending)
+          m_Socket->Shutdown();
         break;
       }
     }
   }
+
+  // a parked streamer gives its device back right away
+  {
+    cMutexLock lock(&m_Mutex);
+    m_Expired = true;
+    sending = m_Sending;
+    m_Sending = false;
+    m_Event.Broadcast();
+  }
+  if (!sending)
+    Close();
+
   INFOLOG("exit streamer thread");
 }
 
-bool cLiveStreamer::StreamChannel(const cChannel *channel, int priority, cxSocket *Socket, cResponsePacket *resp)
+bool cLiveStreamer::StreamChannel(const cChannel *channel, int priority, cxSocket *Socket, cResponsePacket *resp, uint32_t token)
 {
   if (channel == NULL)
   {
@@ -323,12 +509,15 @@ bool cLiveStreamer::StreamChannel(const cChannel *channel, int priority, cxSocke
   m_Channel   = channel;
   m_Priority  = priority;
   m_Socket    = Socket;
+  m_Token     = token;
 
   if (!Open())
     return false;
 
   // Send the OK response here, that it is before the Stream end message
   resp->add_U32(VNSI_RET_OK);
+  if (m_Token)
+    resp->add_U32(m_Token);
   resp->finalise();
   m_Socket->write(resp->getPtr(), resp->getLen());
 
@@ -369,13 +558,30 @@ void cLiveStreamer::sendStreamPacket(sStreamPacket *pkt)
   m_Socket->write(pkt->data, pkt->size);
   m_Socket->UnlockWrite();
 
-  m_last_tick.Set(0);
-  m_SignalLost = false;
+  if (!m_PacketBuffer)
+  {
+    m_last_tick.Set(0);
+    m_SignalLost = false;
+  }
 }
 
 void cLiveStreamer::sendStreamChange()
 {
+  // the layout was stored with the packets, the demuxer may be far ahead
+  if (m_PacketBuffer)
+  {
+    const std::vector<uint8_t> &change = m_PacketBuffer->GetChange();
+    m_Socket->write(change.data(), change.size());
+    return;
+  }
+
   cResponsePacket resp;
+  buildStreamChange(resp);
+  m_Socket->write(resp.getPtr(), resp.getLen());
+}
+
+void cLiveStreamer::buildStreamChange(cResponsePacket &resp)
+{
   resp.initStream(VNSI_STREAM_CHANGE, 0, 0, 0, 0, 0);
 
   uint32_t FpsScale, FpsRate, Height, Width;
@@ -508,7 +714,6 @@ void cLiveStreamer::sendStreamChange()
   }
 
   resp.finaliseStream();
-  m_Socket->write(resp.getPtr(), resp.getLen());
 }
 
 void cLiveStreamer::sendSignalInfo()
@@ -672,11 +877,17 @@ void cLiveStreamer::sendBufferStatus()
   cResponsePacket resp;
   resp.initStream(VNSI_STREAM_BUFFERSTATS, 0, 0, 0, 0, 0);
   uint32_t start, end;
-  bool timeshift;
-  m_Demuxer.BufferStatus(timeshift, start, end);
+  bool timeshift = true;
+  if (m_PacketBuffer)
+    m_PacketBuffer->BufferStatus(start, end);
+  else
+    m_Demuxer.BufferStatus(timeshift, start, end);
   resp.add_U8(timeshift);
   resp.add_U32(start);
   resp.add_U32(end);
+  // counters follow the fields clients know, older clients ignore them
+  resp.add_U32(m_VideoBuffer->GetResyncCount());
+  resp.add_U32(m_VideoBuffer->GetOverflowCount() + (m_PacketBuffer ? m_PacketBuffer->GetOverflowCount() : 0));
   resp.finaliseStream();
   m_Socket->write(resp.getPtr(), resp.getLen());
 }
@@ -696,11 +907,402 @@ void cLiveStreamer::sendRefTime(sStreamPacket *pkt)
 
 bool cLiveStreamer::SeekTime(int64_t time, uint32_t &serial)
 {
+  if (m_PacketBuffer)
+  {
+    bool ret = m_PacketBuffer->Seek(time);
+    serial = m_PacketBuffer->GetSerial();
+    return ret;
+  }
+
   bool ret = m_Demuxer.SeekTime(time);
   serial = m_Demuxer.GetSerial();
   return ret;
 }
 
+// Behind the live edge, packets are sent no further ahead of the playback
+// of the client than PacingLead seconds. Its clock starts with the first
+// packet sent after a seek or resume, and restarts on jumps in the stream
+// or when the client stalled. While packets are held back the socket is
+// also capped at a multiple of the stream's bitrate, so the kernel spreads
+// each batch instead of sending it as one burst. Plain live streams and a
+// reader that caught up with the write head are not paced: the clock and
+// the cap are dropped as soon as the reader gets there or runs dry. All of
+// it is guarded by m_PaceMutex as the sender thread paces a packet buffer.
+#define PACING_SLACK       5000
+#define PACING_RATE_FACTOR 2
+#define PACING_MIN_RATE    KILOBYTE(256)
+
+void cLiveStreamer::Pace(const sStreamPacket *pkt)
+{
+  if (!PacingLead || pkt->dts == DVD_NOPTS_VALUE)
+    return;
+
+  cMutexLock lock(&m_PaceMutex);
+  if (!m_PaceBehind)
+    return;
+
+  uint64_t now = cTimeMs::Now();
+  if (m_PaceDts != DVD_NOPTS_VALUE && pkt->serial == m_PaceSerial)
+  {
+    int64_t ahead = (pkt->dts - m_PaceDts) / (DVD_TIME_BASE / 1000) - (int64_t)(now - m_PaceStart);
+    if (ahead <= PacingLead * 1000 + PACING_SLACK && ahead >= -PACING_SLACK)
+    {
+      if (pkt->dts > m_PaceLastDts)
+        m_PaceLastDts = pkt->dts;
+      m_PaceBytes += pkt->size;
+      return;
+    }
+  }
+
+  m_PaceDts = m_PaceLastDts = pkt->dts;
+  m_PaceStart = now;
+  m_PaceSerial = pkt->serial;
+  m_PaceBytes = pkt->size;
+}
+
+// ms to wait before sending more
+int cLiveStreamer::PacingDelay()
+{
+  if (!PacingLead)
+    return 0;
+
+  bool behind = m_PacketBuffer ? m_PacketBuffer->IsBehindLive() : m_Demuxer.IsBehindLive();
+  uint32_t serial = m_PacketBuffer ? m_PacketBuffer->GetSerial() : m_Demuxer.GetSerial();
+  cMutexLock lock(&m_PaceMutex);
+  m_PaceBehind = behind;
+  if (!behind)
+  {
+    ResetPacing();
+    return 0;
+  }
+  if (m_PaceDts == DVD_NOPTS_VALUE || m_PaceSerial != serial)
+    return 0;
+
+  int64_t duration = (m_PaceLastDts - m_PaceDts) / (DVD_TIME_BASE / 1000);
+  int64_t delay = duration - (int64_t)(cTimeMs::Now() - m_PaceStart) - PacingLead * 1000;
+  if (delay <= 0)
+    return 0;
+
+  if (duration >= 1000)
+  {
+    uint64_t rate = m_PaceBytes * 1000 / duration * PACING_RATE_FACTOR;
+    if (rate < PACING_MIN_RATE)
+      rate = PACING_MIN_RATE;
+    if (rate > 0xFFFFFFFF)
+      rate = 0xFFFFFFFF;
+    if (rate > m_PacingRate * 5 / 4 || rate < m_PacingRate * 3 / 4)
+    {
+      m_Socket->SetPacingRate(rate);
+      m_PacingRate = rate;
+    }
+  }
+  return delay;
+}
+
+void cLiveStreamer::ResetPacing()
+{
+  cMutexLock lock(&m_PaceMutex);
+  m_PaceDts = DVD_NOPTS_VALUE;
+  if (m_PacingRate)
+  {
+    m_Socket->SetPacingRate(0);
+    m_PacingRate = 0;
+  }
+}
+
+bool cLiveStreamer::Export(time_t start, time_t end, const char *name)
+{
+  return m_Demuxer.Export(start, end, name);
+}
+
+bool cLiveStreamer::Promote()
+{
+  // a post-demux buffer keeps the stream anyway
+  if (m_PacketBuffer)
+    return true;
+  return m_Demuxer.Promote();
+}
+
+// the stream thread stores what it would send, the sender replays it
+void cLiveStreamer::storePacket(sStreamPacket *pkt, sStreamPacket *pkt_side_data, bool &requestStreamChangeData, bool &requestStreamChangeSideData)
+{
+  if (pkt->data)
+  {
+    if (pkt->streamChange || requestStreamChangeData)
+    {
+      cResponsePacket resp;
+      buildStreamChange(resp);
+      m_PacketBuffer->PutChange(resp.getPtr(), resp.getLen());
+    }
+    requestStreamChangeData = false;
+    m_PacketBuffer->Put(pkt, pkt->frametype == PKT_I_FRAME || !m_Channel->Vpid());
+  }
+
+  if (pkt_side_data->data)
+  {
+    if (pkt_side_data->streamChange || requestStreamChangeSideData)
+    {
+      cResponsePacket resp;
+      buildStreamChange(resp);
+      m_PacketBuffer->PutChange(resp.getPtr(), resp.getLen());
+    }
+    requestStreamChangeSideData = false;
+    m_PacketBuffer->Put(pkt_side_data, false);
+    pkt_side_data->data = NULL;
+  }
+
+  // the input is alive, no matter when the client gets the packets
+  m_last_tick.Set(0);
+  m_SignalLost = false;
+}
+
+void cLiveStreamer::sendStored()
+{
+  sStreamPacket packets[DEMUX_BATCH_SIZE];
+
+  // far enough ahead of the client's playback, let it catch up
+  int delay = PacingDelay();
+  if (delay > 0)
+  {
+    cCondWait::SleepMs(delay < 100 ? delay : 100);
+    return;
+  }
+
+  int ret = m_PacketBuffer->Read(packets, DEMUX_BATCH_SIZE);
+  if (ret <= 0)
+  {
+    // at the live edge, nothing to pace
+    ResetPacing();
+    m_PacketBuffer->WaitForData(100);
+    return;
+  }
+
+  for (int i = 0; i < ret; i++)
+  {
+    if (packets[i].streamChange)
+      sendStreamChange();
+    if (packets[i].reftime)
+      sendRefTime(&packets[i]);
+    sendStreamPacket(&packets[i]);
+    Pace(&packets[i]);
+  }
+}
+
+bool cLiveStreamer::ParkStream(int graceTime)
+{
+  cMutexLock lock(&m_Mutex);
+
+  if (m_Expired)
+    return false;
+
+  m_Parked = true;
+  m_ParkTimer.Set(graceTime * 1000);
+
+  // the stream thread must not write to the socket of the client anymore
+  while (m_Sending)
+  {
+    if (!m_Event.TimedWait(m_Mutex, 1000))
+      return false;
+  }
+
+  // drop the rate cap while the socket is still there
+  ResetPacing();
+  return !m_Expired;
+}
+
+bool cLiveStreamer::ResumeStream(cxSocket *Socket, cResponsePacket *resp, uint32_t token, int64_t time)
+{
+  cMutexLock lock(&m_Mutex);
+
+  if (m_Expired || !Active())
+    return false;
+
+  m_Socket = Socket;
+  m_Token = token;
+  m_ResumeTime = time;
+  resp->add_U32(VNSI_RET_OK);
+  if (m_Token)
+    resp->add_U32(m_Token);
+  resp->finalise();
+  m_Socket->write(resp->getPtr(), resp->getLen());
+
+  m_Parked = false;
+  m_Resume = true;
+  m_Event.Broadcast();
+  return true;
+}
+
+void cLiveStreamer::Park(cLiveStreamer *streamer)
+{
+  if (BackZapChannels <= 0 || !streamer->ParkStream(BackZapGraceTime))
+  {
+    delete streamer;
+    return;
+  }
+
+  INFOLOG("keep channel %s for back-zap", streamer->m_Channel->Name());
+
+  std::list<cLiveStreamer*> expired;
+  {
+    cMutexLock lock(&m_BackZapMutex);
+    m_BackZap.push_front(streamer);
+    for (std::list<cLiveStreamer*>::iterator it = m_BackZap.begin(); it != m_BackZap.end();)
+    {
+      if (!(*it)->Active())
+      {
+        expired.push_back(*it);
+        it = m_BackZap.erase(it);
+      }
+      else
+        ++it;
+    }
+    while (m_BackZap.size() > (size_t)BackZapChannels)
+    {
+      expired.push_back(m_BackZap.back());
+      m_BackZap.pop_back();
+    }
+  }
+
+  // stopping the threads takes a moment, do it without the lock
+  for (std::list<cLiveStreamer*>::iterator it = expired.begin(); it != expired.end(); ++it)
+    delete *it;
+}
+
+cLiveStreamer *cLiveStreamer::Resume(const cChannel *channel, int priority, uint8_t timeshift, cxSocket *Socket, cResponsePacket *resp, uint32_t token)
+{
+  cLiveStreamer *streamer = NULL;
+  {
+    cMutexLock lock(&m_BackZapMutex);
+    for (std::list<cLiveStreamer*>::iterator it = m_BackZap.begin(); it != m_BackZap.end(); ++it)
+    {
+      if ((*it)->m_Channel == channel &&
+          (*it)->m_Priority == priority &&
+          (*it)->m_Timeshift == timeshift)
+      {
+        streamer = *it;
+        m_BackZap.erase(it);
+        break;
+      }
+    }
+  }
+
+  if (!streamer)
+    return NULL;
+
+  if (!streamer->ResumeStream(Socket, resp, token))
+  {
+    delete streamer;
+    return NULL;
+  }
+
+  INFOLOG("Resumed channel %i - %s from back-zap", channel->Number(), channel->Name());
+  return streamer;
+}
+
+void cLiveStreamer::ParkSession(cLiveStreamer *streamer)
+{
+  // without a token the client can't come back, keep it for back-zap only
+  if (!streamer->m_Token || ResumeGraceTime <= 0)
+  {
+    Park(streamer);
+    return;
+  }
+
+  if (!streamer->ParkStream(ResumeGraceTime))
+  {
+    delete streamer;
+    return;
+  }
+
+  INFOLOG("keep channel %s for client to reconnect", streamer->m_Channel->Name());
+
+  cMutexLock lock(&m_BackZapMutex);
+  m_Sessions.push_front(streamer);
+}
+
+cLiveStreamer *cLiveStreamer::ResumeSession(uint32_t token, int64_t time, uint32_t newToken, cxSocket *Socket, cResponsePacket *resp)
+{
+  cLiveStreamer *streamer = NULL;
+  {
+    cMutexLock lock(&m_BackZapMutex);
+    for (std::list<cLiveStreamer*>::iterator it = m_Sessions.begin(); it != m_Sessions.end(); ++it)
+    {
+      if ((*it)->m_Token == token)
+      {
+        streamer = *it;
+        m_Sessions.erase(it);
+        break;
+      }
+    }
+  }
+
+  if (!streamer)
+    return NULL;
+
+  if (!streamer->ResumeStream(Socket, resp, newToken, time))
+  {
+    delete streamer;
+    return NULL;
+  }
+
+  INFOLOG("Resumed channel %i - %s for reconnected client", streamer->m_Channel->Number(), streamer->m_Channel->Name());
+  return streamer;
+}
+
+void cLiveStreamer::ExpireSessions()
+{
+  std::list<cLiveStreamer*> expired;
+  {
+    cMutexLock lock(&m_BackZapMutex);
+    for (std::list<cLiveStreamer*>::iterator it = m_Sessions.begin(); it != m_Sessions.end();)
+    {
+      if (!(*it)->Active())
+      {
+        expired.push_back(*it);
+        it = m_Sessions.erase(it);
+      }
+      else
+        ++it;
+    }
+  }
+
+  for (std::list<cLiveStreamer*>::iterator it = expired.begin(); it != expired.end(); ++it)
+    delete *it;
+}
+
+bool cLiveStreamer::EvictParked()
+{
+  cLiveStreamer *streamer;
+  {
+    cMutexLock lock(&m_BackZapMutex);
+    // back-zap goes first, a waiting client is more likely to come back
+    std::list<cLiveStreamer*> &parked = m_BackZap.empty() ? m_Sessions : m_BackZap;
+    if (parked.empty())
+      return false;
+    streamer = parked.back();
+    parked.pop_back();
+  }
+
+  INFOLOG("release parked channel %s", streamer->m_Channel->Name());
+  delete streamer;
+  return true;
+}
+
+void cLiveStreamer::RetuneParked(const cChannel *channel)
+{
+  cMutexLock lock(&m_BackZapMutex);
+  for (std::list<cLiveStreamer*>::iterator it = m_BackZap.begin(); it != m_BackZap.end(); ++it)
+    (*it)->RetuneChannel(channel);
+  for (std::list<cLiveStreamer*>::iterator it = m_Sessions.begin(); it != m_Sessions.end(); ++it)
+    (*it)->RetuneChannel(channel);
+}
+
+void cLiveStreamer::ClearParked()
+{
+  while (EvictParked())
+    ;
+}
+
 void cLiveStreamer::RetuneChannel(const cChannel *channel)
 {
   if (m_Channel != channel || !m_VideoInput.IsOpen())
@@ -45,6 +45,8 @@ class cTSParser;
 class cResponsePacket;
 class cVideoBuffer;
 class cVideoInput;
+class cPacketBuffer;
+class cStreamSender;
 
 class cLiveStreamer : public cThread
 {
@@ -52,9 +54,13 @@ private:
   friend class cParser;
   friend class cLivePatFilter;
   friend class cLiveReceiver;
+  friend class cStreamSender;
 
   void sendStreamPacket(sStreamPacket *pkt);
   void sendStreamChange();
+  void buildStreamChange(cResponsePacket &resp);
+  void storePacket(sStreamPacket *pkt, sStreamPacket *pkt_side_data, bool &requestStreamChangeData, bool &requestStreamChangeSideData);
+  void sendStored();
   void sendSignalInfo();
   void sendStreamStatus();
   void sendBufferStatus();
@@ -78,12 +84,39 @@ private:
   cResponsePacket   m_streamHeader;
   cVNSIDemuxer      m_Demuxer;
   cVideoBuffer     *m_VideoBuffer;
+  cPacketBuffer    *m_PacketBuffer;                 /*!> Timeshift after the demuxer, replayed by m_Sender */
+  cStreamSender    *m_Sender;
   cVideoInput       m_VideoInput;
   int               m_Priority;
   uint8_t           m_Timeshift;
   cCondVar          m_Event;
   cMutex            m_Mutex;
   bool              m_IsRetune;
+  bool              m_Parked;                       /*!> Kept for back-zap, demuxing without sending */
+  bool              m_Sending;                      /*!> Stream thread is sending to the client */
+  bool              m_Resume;
+  bool              m_Expired;
+  cTimeMs           m_ParkTimer;
+  uint32_t          m_Token;                        /*!> Lets a reconnecting client resume the stream, 0 if not */
+  int64_t           m_ResumeTime;                   /*!> Position the resumed client acknowledged last */
+  int64_t           m_PaceDts;                      /*!> DTS the playback clock of the client started at */
+  int64_t           m_PaceLastDts;                  /*!> Latest DTS sent */
+  uint64_t          m_PaceStart;                    /*!> Wall clock in ms the playback clock started at */
+  uint64_t          m_PaceBytes;                    /*!> Bytes sent since the playback clock started */
+  uint32_t          m_PaceSerial;
+  uint32_t          m_PacingRate;                   /*!> Rate cap of the socket, 0 if none */
+  bool              m_PaceBehind;                   /*!> Reader is behind the live edge, packets are paced */
+  cMutex            m_PaceMutex;                    /*!> Guards the pacing state, shared with m_Sender */
+
+  static std::list<cLiveStreamer*> m_BackZap;       /*!> Parked streamers, most recent first */
+  static std::list<cLiveStreamer*> m_Sessions;     /*!> Parked streamers of disconnected clients */
+  static cMutex     m_BackZapMutex;
+
+  bool ParkStream(int graceTime);
+  bool ResumeStream(cxSocket *Socket, cResponsePacket *resp, uint32_t token, int64_t time = DVD_NOPTS_VALUE);
+  void Pace(const sStreamPacket *pkt);
+  int PacingDelay();
+  void ResetPacing();
 
 protected:
   virtual void Action(void);
@@ -96,12 +129,23 @@ public:
 
   void Activate(bool On);
 
-  bool StreamChannel(const cChannel *channel, int priority, cxSocket *Socket, cResponsePacket* resp);
+  bool StreamChannel(const cChannel *channel, int priority, cxSocket *Socket, cResponsePacket* resp, uint32_t token = 0);
   bool IsStarting() { return m_startup; }
   bool IsAudioOnly() { return m_IsAudioOnly; }
   bool IsMPEGPS() { return m_IsMPEGPS; }
   bool SeekTime(int64_t time, uint32_t &serial);
+  bool Export(time_t start, time_t end, const char *name);
+  bool Promote();
   void RetuneChannel(const cChannel *channel);
+
+  static void Park(cLiveStreamer *streamer);
+  static cLiveStreamer *Resume(const cChannel *channel, int priority, uint8_t timeshift, cxSocket *Socket, cResponsePacket *resp, uint32_t token = 0);
+  static void ParkSession(cLiveStreamer *streamer);
+  static cLiveStreamer *ResumeSession(uint32_t token, int64_t time, uint32_t newToken, cxSocket *Socket, cResponsePacket *resp);
+  static void ExpireSessions();
+  static bool EvictParked();
+  static void RetuneParked(const cChannel *channel);
+  static void ClearParked();
 };
 
 #endif  // VNSI_RECEIVER_H
@@ -0,0 +1,327 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Feeds generated H.264, HEVC and MPEG-2 streams through the video parsers
+ * and checks that every frame comes out exactly as it was muxed. The
+ * streams start PES-aligned, so the parsers skip the rest of each frame,
+ * and then break the alignment: PES packets carrying two frames, and
+ * frames that begin in the middle of a PES packet. The parsers must find
+ * out and scan the skipped bytes after all.
+ */
+
+#include "../parser.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+int PesBufferMaxSize = 8;
+
+#define FRAMES 600
+
+enum eMux
+{
+  muxAligned,
+  muxDouble,
+  muxMixed
+};
+
+static uint32_t rnd;
+
+static int Random(int min, int max)
+{
+  rnd ^= rnd << 13;
+  rnd ^= rnd >> 17;
+  rnd ^= rnd << 5;
+  return min + rnd % (max - min + 1);
+}
+
+class cBitWriter
+{
+public:
+  void Put(uint32_t value, int bits)
+  {
+    for (int i = bits - 1; i >= 0; i--)
+      m_Bits.push_back((value >> i) & 1);
+  }
+  void PutZeros(int bits)
+  {
+    m_Bits.insert(m_Bits.end(), bits, 0);
+  }
+  void PutUE(uint32_t value)
+  {
+    value++;
+    int bits = 32 - __builtin_clz(value);
+    PutZeros(bits - 1);
+    Put(value, bits);
+  }
+  std::string Bytes()
+  {
+    m_Bits.push_back(1);
+    while (m_Bits.size() % 8)
+      m_Bits.push_back(0);
+    std::string out;
+    for (size_t i = 0; i < m_Bits.size(); i += 8)
+    {
+      uint8_t byte = 0;
+      for (int j = 0; j < 8; j++)
+        byte = byte << 1 | m_Bits[i + j];
+      out += (char)byte;
+    }
+    return out;
+  }
+
+private:
+  std::vector<uint8_t> m_Bits;
+};
+
+// slice data never holds a zero byte, so no start code by accident
+static std::string Payload(int size)
+{
+  std::string out;
+  for (int i = 0; i < size; i++)
+    out += (char)Random(0x80, 0xff);
+  return out;
+}
+
+static std::string StartCode(const char *nal, int len)
+{
+  return std::string("\0\0\1", 3) + std::string(nal, len);
+}
+
+static std::string H264Frame(int i, char type)
+{
+  std::string frame = std::string("\0\0\0\1\x09\xf0", 6);
+  if (type == 'I')
+  {
+    cBitWriter sps;
+    sps.Put(66, 8); sps.Put(0, 8); sps.Put(30, 8);
+    sps.PutUE(0); sps.PutUE(0); sps.PutUE(0); sps.PutUE(0); sps.PutUE(1);
+    sps.Put(0, 1); sps.PutUE(119); sps.PutUE(67);
+    sps.Put(1, 1); sps.Put(1, 1); sps.Put(0, 1); sps.Put(0, 1);
+    frame += StartCode("\x67", 1) + sps.Bytes() + Payload(300);
+
+    cBitWriter pps;
+    pps.PutUE(0); pps.PutUE(0); pps.Put(0, 1); pps.Put(0, 1);
+    frame += StartCode("\x68", 1) + pps.Bytes() + Payload(70);
+  }
+
+  int slices = Random(1, 4);
+  for (int s = 0; s < slices; s++)
+  {
+    cBitWriter slice;
+    slice.PutUE(s * 100);
+    slice.PutUE(type == 'I' ? 7 : type == 'P' ? 5 : 6);
+    slice.PutUE(0);
+    slice.Put(i & 15, 4);
+    if (type == 'I')
+      slice.PutUE(i & 1);
+    slice.Put((2 * i) & 15, 4);
+    frame += StartCode(type == 'I' ? "\x65" : type == 'P' ? "\x41" : "\x01", 1) + slice.Bytes() + Payload(Random(200, 20000));
+  }
+  return frame;
+}
+
+static std::string HEVCFrame(int i, char type)
+{
+  std::string frame = std::string("\0\0\0\1\x46\x01\x50", 7);
+  if (type == 'I')
+  {
+    frame += StartCode("\x40\x01", 2) + Payload(20);
+
+    cBitWriter sps;
+    sps.Put(0, 4); sps.Put(0, 3); sps.Put(1, 1); sps.PutZeros(8 + 32 + 4 + 43 + 1 + 8);
+    sps.PutUE(0); sps.PutUE(1); sps.PutUE(1920); sps.PutUE(1080);
+    frame += StartCode("\x42\x01", 2) + sps.Bytes() + Payload(300);
+
+    cBitWriter pps;
+    pps.PutUE(0); pps.PutUE(0); pps.Put(0, 1);
+    frame += StartCode("\x44\x01", 2) + pps.Bytes() + Payload(50);
+  }
+
+  int slices = Random(1, 4);
+  for (int s = 0; s < slices; s++)
+  {
+    cBitWriter slice;
+    slice.Put(s == 0, 1);
+    if (type == 'I')
+      slice.Put(0, 1);
+    slice.PutUE(0);
+    char nal[2] = { (char)((type == 'I' ? 19 : 1) << 1), 1 };
+    frame += StartCode(nal, 2) + slice.Bytes() + Payload(Random(200, 20000));
+  }
+  return frame;
+}
+
+static std::string MPEG2Frame(int i, char type)
+{
+  std::string frame;
+  if (type == 'I')
+  {
+    cBitWriter seq;
+    seq.Put(720, 12); seq.Put(576, 12); seq.Put(2, 4); seq.Put(3, 4);
+    seq.Put(0x3ffff, 18); seq.Put(1, 1); seq.Put(0, 10); seq.Put(0, 3);
+    frame += StartCode("\xb3", 1) + seq.Bytes() + Payload(20);
+    frame += StartCode("\xb8", 1) + Payload(4);
+  }
+
+  cBitWriter pic;
+  pic.Put(i & 1023, 10); pic.Put(type == 'I' ? 1 : type == 'P' ? 2 : 3, 3); pic.Put(0xffff, 16); pic.Put(0, 3);
+  frame += StartCode("\x00", 1) + pic.Bytes();
+  frame += StartCode("\xb5", 1) + Payload(5);
+
+  int slices = Random(1, 30);
+  for (int s = 0; s < slices; s++)
+  {
+    char nal = s + 1;
+    frame += StartCode(&nal, 1) + Payload(Random(50, 2000));
+  }
+  return frame;
+}
+
+static std::string PES(const std::string &data, int64_t pts)
+{
+  uint8_t header[14] = { 0x00, 0x00, 0x01, 0xe0, 0x00, 0x00, 0x80, 0x80, 0x05,
+                         (uint8_t)(0x21 | ((pts >> 29) & 0x0e)), (uint8_t)(pts >> 22),
+                         (uint8_t)(0x01 | ((pts >> 14) & 0xfe)), (uint8_t)(pts >> 7),
+                         (uint8_t)(0x01 | ((pts << 1) & 0xfe)) };
+  return std::string((char*)header, sizeof(header)) + data;
+}
+
+// muxes the frames, returns the TS packets
+static std::string Mux(const std::vector<std::string> &frames, eMux mux)
+{
+  std::vector<std::pair<std::string, int64_t> > packets;
+  int64_t pts = 90000;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    std::string frame = frames[i];
+    if (mux == muxMixed && i >= 200 && i < 400)
+    {
+      // a tail of the previous frame goes into this PES packet
+      std::string &prev = packets.back().first;
+      int cut = Random(1, prev.size() - 20);
+      if (cut > 15)
+      {
+        frame = prev.substr(cut) + frame;
+        prev.resize(cut);
+      }
+    }
+    if (mux == muxDouble && i >= 100 && i % 37 == 0)
+      packets.back().first += frame;
+    else
+      packets.push_back(std::make_pair(frame, pts));
+    pts += 3600;
+  }
+
+  std::string ts;
+  int cc = 0;
+  for (size_t i = 0; i < packets.size(); i++)
+  {
+    std::string pes = PES(packets[i].first, packets[i].second);
+    for (size_t pos = 0; pos < pes.size(); pos += 184)
+    {
+      size_t len = std::min(pes.size() - pos, (size_t)184);
+      uint8_t header[4] = { 0x47, (uint8_t)((pos ? 0x00 : 0x40) | 0x01), 0x00, (uint8_t)((len < 184 ? 0x30 : 0x10) | cc) };
+      ts += std::string((char*)header, 4);
+      if (len < 184)
+      {
+        // adaptation field stuffing
+        int stuffing = 184 - len;
+        ts += (char)(stuffing - 1);
+        if (stuffing > 1)
+          ts += std::string(1, 0) + std::string(stuffing - 2, (char)0xff);
+      }
+      ts += pes.substr(pos, len);
+      cc = (cc + 1) & 15;
+    }
+  }
+  return ts;
+}
+
+static bool Check(eStreamType type, const char *name, eMux mux)
+{
+  static const char *muxNames[] = { "aligned", "double", "mixed" };
+
+  rnd = 2463534242u;
+  std::vector<std::string> frames;
+  for (int i = 0; i < FRAMES; i++)
+  {
+    char frameType = i % 25 == 0 ? 'I' : i % 3 == 0 ? 'P' : 'B';
+    if (type == stH264)
+      frames.push_back(H264Frame(i, frameType));
+    else if (type == stHEVC)
+      frames.push_back(HEVCFrame(i, frameType));
+    else
+      frames.push_back(MPEG2Frame(i, frameType));
+  }
+  std::string ts = Mux(frames, mux);
+
+  // the first frame waits for the stream properties, the last one for a
+  // start code after it
+  sPtsWrap ptsWrap = { false, 0, 0 };
+  cTSStream stream(type, 0x100, &ptsWrap);
+  size_t next = 1;
+  for (size_t pos = 0; pos + TS_SIZE <= ts.size(); pos += TS_SIZE)
+  {
+    sStreamPacket pkt, side;
+    memset(&pkt, 0, sizeof(pkt));
+    memset(&side, 0, sizeof(side));
+    stream.ProcessTSPacket((uint8_t*)&ts[pos], &pkt, &side, false);
+    if (!pkt.data)
+      continue;
+    // frames are cut at the 00 00 01 of their first start code, zeros in
+    // front of it go with the frame before
+    if (next + 1 >= frames.size() ||
+        std::string((char*)pkt.data, pkt.size) != frames[next].substr(frames[next].find(std::string("\0\0\1", 3))) +
+                                                  frames[next + 1].substr(0, frames[next + 1].find(std::string("\0\0\1", 3))))
+    {
+      fprintf(stderr, "%s %s: frame %d differs\n", name, muxNames[mux], (int)next);
+      return false;
+    }
+    next++;
+  }
+  if (next != frames.size() - 1)
+  {
+    fprintf(stderr, "%s %s: %d of %d frames\n", name, muxNames[mux], (int)next - 1, FRAMES - 2);
+    return false;
+  }
+  return true;
+}
+
+int main()
+{
+  bool ok = true;
+  for (int mux = muxAligned; mux <= muxMixed; mux++)
+  {
+    ok &= Check(stH264, "h264", (eMux)mux);
+    ok &= Check(stHEVC, "hevc", (eMux)mux);
+    ok &= Check(stMPEG2VIDEO, "mpeg2", (eMux)mux);
+  }
+  fprintf(stderr, "pesaligned: %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Checks FindStartCode against the byte loop it replaced, on generated
+ * elementary streams and on random data from sparse to dense in zeros.
+ * Streams are scanned in pieces of TS payload size or random size, with
+ * the scan state carried over, so start codes split between calls are
+ * covered. FindStartCodeScalar is startcode.c built without SSE2.
+ */
+
+#include "../startcode.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+int FindStartCodeScalar(const uint8_t *buf, int p, int end, uint32_t &startcode);
+
+static uint32_t rnd = 2463534242u;
+
+static int Random(int min, int max)
+{
+  rnd ^= rnd << 13;
+  rnd ^= rnd >> 17;
+  rnd ^= rnd << 5;
+  return min + rnd % (max - min + 1);
+}
+
+// what the parsers did before, one byte at a time
+static int FindStartCodeBytes(const uint8_t *buf, int p, int end, uint32_t &startcode)
+{
+  while (p < end)
+  {
+    startcode = startcode << 8 | buf[p++];
+    if ((startcode & 0x00ffffff) == 0x00000001)
+      break;
+  }
+  return p;
+}
+
+// NAL units with 3 and 4 byte start codes, trailing zeros and payload
+// that may hold 00 00 02 and 00 00 03
+static std::vector<uint8_t> Stream(int size)
+{
+  std::vector<uint8_t> buf;
+  while ((int)buf.size() < size)
+  {
+    if (Random(0, 1))
+      buf.push_back(0);
+    buf.push_back(0);
+    buf.push_back(0);
+    buf.push_back(1);
+    buf.push_back(Random(0, 255));
+    int len = Random(0, 3) ? Random(1, 64) : Random(64, 4000);
+    for (int i = 0; i < len; i++)
+    {
+      int r = Random(0, 99);
+      buf.push_back(r < 2 ? 0 : r < 3 ? 2 : r < 4 ? 3 : Random(1, 255));
+    }
+    for (int i = Random(-4, 2); i > 0; i--)
+      buf.push_back(0);
+  }
+  buf.resize(size);
+  return buf;
+}
+
+static std::vector<uint8_t> Noise(int size, int zeros)
+{
+  std::vector<uint8_t> buf(size);
+  for (int i = 0; i < size; i++)
+  {
+    int r = Random(0, 99);
+    buf[i] = r < zeros ? 0 : r < zeros + 5 ? 1 : Random(0, 255);
+  }
+  return buf;
+}
+
+// scans buf from start in pieces, every variant must stop at the same
+// positions with the same state
+static bool Compare(const std::vector<uint8_t> &buf, int start, int piece, long &found)
+{
+  uint32_t initial = Random(0, 2) ? 0xffffffff : Random(0, 1) ? 0 : rnd;
+  uint32_t bytes = initial, sse = initial, scalar = initial;
+  int p = start;
+  while (p < (int)buf.size())
+  {
+    int end = p + (piece ? piece : Random(1, 400));
+    if (end > (int)buf.size())
+      end = buf.size();
+
+    while (p < end)
+    {
+      int q = p;
+      p = FindStartCodeBytes(buf.data(), q, end, bytes);
+      int r = FindStartCode(buf.data(), q, end, sse);
+      int s = FindStartCodeScalar(buf.data(), q, end, scalar);
+      if (r != p || sse != bytes || s != p || scalar != bytes)
+      {
+        fprintf(stderr, "startcode: from %d to %d, bytes %d %08x, sse2 %d %08x, scalar %d %08x\n",
+                q, end, p, bytes, r, sse, s, scalar);
+        return false;
+      }
+      if ((bytes & 0x00ffffff) == 0x00000001)
+        found++;
+    }
+  }
+  return true;
+}
+
+int main()
+{
+  bool ok = true;
+  long found = 0;
+
+  for (int i = 0; i < 200 && ok; i++)
+  {
+    std::vector<uint8_t> buf = Stream(Random(1, 100000));
+    ok = Compare(buf, 0, 184, found) && Compare(buf, Random(0, 16), 0, found);
+  }
+
+  for (int zeros = 0; zeros <= 100 && ok; zeros += 5)
+  {
+    for (int i = 0; i < 200 && ok; i++)
+    {
+      std::vector<uint8_t> buf = Noise(Random(1, 2000), zeros);
+      ok = Compare(buf, Random(0, buf.size() - 1), 0, found);
+    }
+  }
+
+  fprintf(stderr, "startcode: %s, %ld start codes\n", ok ? "ok" : "FAILED", found);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "timeshiftexport.h"
+#include "videobuffer.h"
+#include "iopriority.h"
+#include "config.h"
+
+#include <vdr/config.h>
+#include <vdr/recording.h>
+#include <vdr/remux.h>
+#include <vdr/videodir.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// blocks never cross a chunk of the buffer
+#define EXPORT_BLOCK_SIZE MEGABYTE(1)
+
+cTimeshiftExport::cTimeshiftExport(cVideoBuffer *buffer, uint64_t from, uint64_t to,
+                                   time_t startTime, time_t endTime, const cChannel *channel,
+                                   const char *name, int videoPid, int videoType)
+  :cThread("VNSI timeshift export")
+{
+  m_Buffer = buffer;
+  m_From = from;
+  m_To = to;
+  m_StartTime = startTime;
+  m_EndTime = endTime;
+  m_Channel = *channel;
+  m_Name = *name ? name : channel->Name();
+  m_VideoPid = videoPid;
+  m_VideoType = videoType;
+}
+
+cTimeshiftExport::~cTimeshiftExport()
+{
+  Cancel(5);
+}
+
+void cTimeshiftExport::Action(void)
+{
+  // a recording running meanwhile must not wait for the copy
+  cIOPriority::Set(IOCLASS_BULK);
+
+  struct tm tm_r;
+  struct tm *t = localtime_r(&m_StartTime, &tm_r);
+  char *name = ExchangeChars(strdup(m_Name), true);
+#if VDRVERSNUM >= 20102
+  cString dir = cString::sprintf("%s/%s/%4d-%02d-%02d.%02d.%02d.%d-0.rec", cVideoDirectory::Name(), name,
+#else
+  cString dir = cString::sprintf("%s/%s/%4d-%02d-%02d.%02d.%02d.%d-0.rec", VideoDirectory, name,
+#endif
+                                 t->tm_year + 1900, t->tm_mon + 1, t->tm_mday, t->tm_hour, t->tm_min,
+                                 m_Channel.Number());
+  free(name);
+
+  if (access(dir, F_OK) == 0 || !MakeDirs(dir, true))
+  {
+    ERRORLOG("Export - could not create recording: %s", (const char*)dir);
+    return;
+  }
+
+  cString fileName = cString::sprintf("%s/00001.ts", (const char*)dir);
+  int fd = open(fileName, O_RDWR | O_CREAT | O_EXCL, DEFFILEMODE);
+  if (fd < 0)
+  {
+    ERRORLOG("Export - could not open file: %s", (const char*)fileName);
+    return;
+  }
+  INFOLOG("Export - writing %llu bytes to: %s", (unsigned long long)(m_To - m_From), (const char*)dir);
+
+  // players pick up the PIDs from the start of the file
+  cPatPmtGenerator patPmtGenerator(&m_Channel);
+  bool ok = safe_write(fd, patPmtGenerator.GetPat(), TS_SIZE) == TS_SIZE;
+  off_t header = TS_SIZE;
+  int index = 0;
+  while (uint8_t *pmt = patPmtGenerator.GetPmt(index))
+  {
+    ok = ok && safe_write(fd, pmt, TS_SIZE) == TS_SIZE;
+    header += TS_SIZE;
+  }
+
+  cIndexFile indexFile(dir, true);
+  cFrameDetector frameDetector(m_VideoPid, m_VideoType);
+
+  // analysed is the stream position of buf, bytes the frame detector did
+  // not take yet are moved to its start
+  uint8_t *buf = (uint8_t*)malloc(2*EXPORT_BLOCK_SIZE);
+  if (!buf)
+    ok = false;
+  uint64_t analysed = m_From;
+  int pending = 0;
+  uint64_t pos = m_From;
+  while (ok && pos < m_To && Running())
+  {
+    unsigned int size = EXPORT_BLOCK_SIZE - pos % EXPORT_BLOCK_SIZE;
+    if (size > m_To - pos)
+      size = m_To - pos;
+    if (!CopyBlock(fd, pos, buf + pending, size))
+    {
+      ok = false;
+      break;
+    }
+    pos += size;
+
+    uint8_t *p = buf;
+    int len = pending + size;
+    while (len >= TS_SIZE)
+    {
+      int count = frameDetector.Analyze(p, len - len % TS_SIZE);
+      if (!count)
+        break;
+      if (frameDetector.Synced() && frameDetector.NewFrame())
+        indexFile.Write(frameDetector.IndependentFrame(), 1, header + (analysed - m_From));
+      p += count;
+      len -= count;
+      analysed += count;
+    }
+    // no frame start within a whole block, skip it
+    if (len > EXPORT_BLOCK_SIZE)
+    {
+      analysed += len;
+      len = 0;
+    }
+    memmove(buf, p, len);
+    pending = len;
+  }
+  free(buf);
+
+  if (close(fd) < 0)
+    ok = false;
+  if (!ok)
+    ERRORLOG("Export - failed at %llu of %llu bytes: %s", (unsigned long long)(pos - m_From),
+             (unsigned long long)(m_To - m_From), (const char*)dir);
+  else if (pos < m_To)
+    INFOLOG("Export - stopped at %llu of %llu bytes: %s", (unsigned long long)(pos - m_From),
+            (unsigned long long)(m_To - m_From), (const char*)dir);
+
+  if (!WriteInfo(dir, frameDetector.FramesPerSecond()))
+    ERRORLOG("Export - could not write info: %s", (const char*)dir);
+
+#if VDRVERSNUM >= 20301
+  LOCK_RECORDINGS_WRITE;
+  Recordings->AddByName(dir);
+#else
+  Recordings.AddByName(dir);
+#endif
+}
+
+// data already on disk is copied within the file system, the frame detector
+// then reads the copy from the recording instead of the timeshift buffer
+bool cTimeshiftExport::CopyBlock(int fd, uint64_t pos, uint8_t *buf, unsigned int size)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+  off_t offset;
+  int src = m_Buffer->GetFile(pos, size, &offset);
+  if (src >= 0)
+  {
+    off_t dest = lseek(fd, 0, SEEK_CUR);
+    unsigned int left = size;
+    while (left)
+    {
+      uint64_t start = cIOPriority::Now();
+      ssize_t r = copy_file_range(src, &offset, fd, NULL, left, 0);
+      cIOPriority::Account(IOCLASS_BULK, r, start);
+      if (r < 0 && errno == EINTR)
+        continue;
+      if (r <= 0)
+        break;
+      left -= r;
+    }
+    if (!left)
+    {
+      // the writer does not wait for us, check it did not get here meanwhile
+      if (!m_Buffer->IsReadable(pos))
+      {
+        ERRORLOG("Export - data was overwritten in the timeshift buffer");
+        return false;
+      }
+      uint64_t start = cIOPriority::Now();
+      ssize_t r = pread(fd, buf, size, dest);
+      cIOPriority::Account(IOCLASS_BULK, r, start);
+      return r == (ssize_t)size;
+    }
+    if (lseek(fd, dest, SEEK_SET) != dest)
+      return false;
+  }
+#endif
+
+  if (!m_Buffer->ReadAt(pos, buf, size))
+  {
+    ERRORLOG("Export - data was overwritten in the timeshift buffer");
+    return false;
+  }
+  uint64_t start = cIOPriority::Now();
+  ssize_t w = safe_write(fd, buf, size);
+  cIOPriority::Account(IOCLASS_BULK, w, start);
+  return w == (ssize_t)size;
+}
+
+bool cTimeshiftExport::WriteInfo(const char *dir, double framesPerSecond)
+{
+  cString fileName = cString::sprintf("%s/info", dir);
+  FILE *f = fopen(fileName, "w");
+  if (!f)
+    return false;
+
+  fprintf(f, "C %s %s\n", (const char*)m_Channel.GetChannelID().ToString(), m_Channel.Name());
+  fprintf(f, "E 0 %ld %d\n", (long)m_StartTime, (int)(m_EndTime - m_StartTime));
+  fprintf(f, "T %s\n", (const char*)m_Name);
+  fprintf(f, "F %.2f\n", framesPerSecond);
+  fprintf(f, "P %d\n", Setup.DefaultPriority);
+  fprintf(f, "L %d\n", Setup.DefaultLifetime);
+  return fclose(f) == 0;
+}
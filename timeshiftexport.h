@@ -0,0 +1,63 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <vdr/channels.h>
+#include <vdr/thread.h>
+
+class cVideoBuffer;
+
+/*!
+ * Writes a part of a timeshift buffer into a new VDR recording: one TS file
+ * starting with PAT/PMT, its index and an info file. Runs in its own thread
+ * and only reads from the buffer, so neither the live stream nor the client
+ * connection waits for it. Deleting it stops the export early, the result
+ * is a shorter but complete recording.
+ */
+class cTimeshiftExport : public cThread
+{
+public:
+  cTimeshiftExport(cVideoBuffer *buffer, uint64_t from, uint64_t to,
+                   time_t startTime, time_t endTime, const cChannel *channel,
+                   const char *name, int videoPid, int videoType);
+  virtual ~cTimeshiftExport();
+
+protected:
+  virtual void Action(void);
+  bool CopyBlock(int fd, uint64_t pos, uint8_t *buf, unsigned int size);
+  bool WriteInfo(const char *dir, double framesPerSecond);
+  cVideoBuffer *m_Buffer;
+  uint64_t m_From;
+  uint64_t m_To;
+  time_t m_StartTime;
+  time_t m_EndTime;
+  cChannel m_Channel;
+  cString m_Name;
+  int m_VideoPid;
+  int m_VideoType;
+};
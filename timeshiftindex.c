@@ -0,0 +1,262 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "timeshiftindex.h"
+
+#include <vdr/remux.h>
+
+// keyframes kept, a few hours at common GOP sizes
+#define INDEX_SIZE (1 << 16)
+
+cTimeshiftIndex::cTimeshiftIndex()
+{
+  m_Entries.resize(INDEX_SIZE);
+  m_Pid = -1;
+  m_Type = 0;
+  Clear();
+}
+
+void cTimeshiftIndex::Clear()
+{
+  cMutexLock lock(&m_Mutex);
+  m_First = 0;
+  m_Count = 0;
+  m_LastPts = -1;
+  m_PtsOffset = 0;
+}
+
+void cTimeshiftIndex::SetVideoPid(int pid, int type)
+{
+  cMutexLock lock(&m_Mutex);
+  m_Pid = pid ? pid : -1;
+  m_Type = type;
+}
+
+// checks the start of a video PES payload for a sequence header or an
+// intra picture
+bool cTimeshiftIndex::IsKeyframe(const uint8_t *buf, int len)
+{
+  for (int i = 0; i + 5 < len; i++)
+  {
+    if (buf[i] || buf[i+1] || buf[i+2] != 1)
+      continue;
+
+    uint8_t code = buf[i+3];
+    if (m_Type == 0x1B)
+    {
+      int nal = code & 0x1F;
+      if (nal == 5 || nal == 7)
+        return true;
+      if (nal == 1)
+        return false;
+    }
+    else if (m_Type == 0x24)
+    {
+      int nal = (code >> 1) & 0x3F;
+      if ((nal >= 16 && nal <= 21) || (nal >= 32 && nal <= 34))
+        return true;
+      if (nal < 16)
+        return false;
+    }
+    else
+    {
+      if (code == 0xB3)
+        return true;
+      if (code == 0x00)
+        return ((buf[i+5] >> 3) & 7) == 1;
+    }
+    i += 3;
+  }
+  return false;
+}
+
+void cTimeshiftIndex::Add(uint64_t abs, off_t pos, int64_t pts)
+{
+  cMutexLock lock(&m_Mutex);
+
+  // unwrap the 33 bit PTS
+  if (m_LastPts >= 0 && pts + (1LL << 32) < m_LastPts)
+    m_PtsOffset += 1LL << 33;
+  m_LastPts = pts;
+
+  size_t i = (m_First + m_Count) % INDEX_SIZE;
+  if (m_Count == INDEX_SIZE)
+    m_First = (m_First + 1) % INDEX_SIZE;
+  else
+    m_Count++;
+  m_Entries[i].abs = abs;
+  m_Entries[i].pos = pos;
+  m_Entries[i].pts = pts + m_PtsOffset;
+  m_Entries[i].time = time(NULL);
+}
+
+// pos is where buf starts in the buffer, which wraps at wrap unless it is 0
+void cTimeshiftIndex::Put(const uint8_t *buf, unsigned int size, uint64_t abs, off_t pos, off_t wrap)
+{
+  if (m_Pid < 0)
+    return;
+
+  for (unsigned int i = 0; i + TS_SIZE <= size; i += TS_SIZE)
+  {
+    const uint8_t *p = buf + i;
+    if (p[0] != TS_SYNC_BYTE)
+      break;
+    if (!TsPayloadStart(p) || TsPid(p) != m_Pid || !TsHasPayload(p))
+      continue;
+
+    bool keyframe = false;
+    int offset = 4;
+    if (TsHasAdaptationField(p))
+    {
+      if (p[4] && (p[5] & 0x40)) // random access indicator
+        keyframe = true;
+      offset += p[4] + 1;
+    }
+
+    const uint8_t *pes = p + offset;
+    int len = TS_SIZE - offset;
+    if (len < 14 || pes[0] || pes[1] || pes[2] != 1 || !(pes[7] & 0x80))
+      continue;
+
+    if (!keyframe && 9 + pes[8] < len)
+      keyframe = IsKeyframe(pes + 9 + pes[8], len - 9 - pes[8]);
+    if (!keyframe)
+      continue;
+
+    int64_t pts = ((int64_t)(pes[9] & 0x0E) << 29) | (pes[10] << 22) |
+                  ((pes[11] & 0xFE) << 14) | (pes[12] << 7) | (pes[13] >> 1);
+    off_t packetPos = pos + i;
+    if (wrap && packetPos >= wrap)
+      packetPos -= wrap;
+    Add(abs + i, packetPos, pts);
+  }
+}
+
+// first entry still in the buffer, m_Count if there is none
+size_t cTimeshiftIndex::FirstValid(uint64_t oldest)
+{
+  size_t lo = 0, hi = m_Count;
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (m_Entries[(m_First + mid) % INDEX_SIZE].abs < oldest)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// last keyframe at or before pts, not older than the oldest absolute offset
+// still in the buffer
+bool cTimeshiftIndex::Find(int64_t pts, uint64_t oldest, off_t *pos)
+{
+  cMutexLock lock(&m_Mutex);
+
+  size_t lo = FirstValid(oldest);
+  if (lo == m_Count)
+    return false;
+
+  const sEntry &first = m_Entries[(m_First + lo) % INDEX_SIZE];
+  const sEntry &last = m_Entries[(m_First + m_Count - 1) % INDEX_SIZE];
+  if (pts > last.pts)
+    return false;
+  if (pts <= first.pts)
+  {
+    *pos = first.pos;
+    return true;
+  }
+
+  // last entry with a PTS not after the target
+  size_t hi = m_Count;
+  while (hi - lo > 1)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (m_Entries[(m_First + mid) % INDEX_SIZE].pts <= pts)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  *pos = m_Entries[(m_First + lo) % INDEX_SIZE].pos;
+  return true;
+}
+
+bool cTimeshiftIndex::Last(uint64_t oldest, off_t *pos)
+{
+  cMutexLock lock(&m_Mutex);
+
+  if (!m_Count)
+    return false;
+
+  const sEntry &last = m_Entries[(m_First + m_Count - 1) % INDEX_SIZE];
+  if (last.abs < oldest)
+    return false;
+  *pos = last.pos;
+  return true;
+}
+
+// keyframes enclosing a wall-clock range: from is the last one before start,
+// to the first one after end or 0 if the range reaches the head
+bool cTimeshiftIndex::Range(time_t start, time_t end, uint64_t oldest,
+                            uint64_t *from, uint64_t *to, time_t *fromTime)
+{
+  cMutexLock lock(&m_Mutex);
+
+  size_t lo = FirstValid(oldest);
+  if (lo == m_Count)
+    return false;
+  if (end < m_Entries[(m_First + lo) % INDEX_SIZE].time)
+    return false;
+
+  // entries are in time order, times have a resolution of a second so
+  // the range starts before the first keyframe of its start second
+  size_t first = lo, hi = m_Count;
+  while (first < hi)
+  {
+    size_t mid = (first + hi) / 2;
+    if (m_Entries[(m_First + mid) % INDEX_SIZE].time < start)
+      first = mid + 1;
+    else
+      hi = mid;
+  }
+  if (first > lo)
+    first--;
+  const sEntry &entry = m_Entries[(m_First + first) % INDEX_SIZE];
+  *from = entry.abs;
+  *fromTime = entry.time;
+
+  size_t last = first + 1;
+  hi = m_Count;
+  while (last < hi)
+  {
+    size_t mid = (last + hi) / 2;
+    if (m_Entries[(m_First + mid) % INDEX_SIZE].time <= end)
+      last = mid + 1;
+    else
+      hi = mid;
+  }
+  *to = last < m_Count ? m_Entries[(m_First + last) % INDEX_SIZE].abs : 0;
+  return true;
+}
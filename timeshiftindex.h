@@ -0,0 +1,74 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <vector>
+#include <vdr/thread.h>
+
+/*!
+ * Keyframe index of a timeshift buffer. The writer feeds every TS packet
+ * it stores, together with its absolute stream offset and its position in
+ * the buffer, and the index remembers both, PTS and wall-clock time of each
+ * video keyframe. Seeks then binary-search the index instead of probing the
+ * buffer.
+ */
+class cTimeshiftIndex
+{
+public:
+  cTimeshiftIndex();
+  void SetVideoPid(int pid, int type);
+  void Put(const uint8_t *buf, unsigned int size, uint64_t abs, off_t pos, off_t wrap);
+  bool Find(int64_t pts, uint64_t oldest, off_t *pos);
+  bool Last(uint64_t oldest, off_t *pos);
+  bool Range(time_t start, time_t end, uint64_t oldest,
+             uint64_t *from, uint64_t *to, time_t *fromTime);
+  int GetPid() const { return m_Pid; }
+  int GetType() const { return m_Type; }
+  void Clear();
+
+protected:
+  struct sEntry
+  {
+    uint64_t abs;
+    off_t pos;
+    int64_t pts;
+    time_t time;
+  };
+  bool IsKeyframe(const uint8_t *buf, int len);
+  size_t FirstValid(uint64_t oldest);
+  void Add(uint64_t abs, off_t pos, int64_t pts);
+  cMutex m_Mutex;
+  std::vector<sEntry> m_Entries;
+  size_t m_First;
+  size_t m_Count;
+  int m_Pid;
+  int m_Type;
+  int64_t m_LastPts;
+  int64_t m_PtsOffset;
+};
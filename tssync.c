@@ -0,0 +1,123 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "tssync.h"
+
+#include <vdr/remux.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TSSYNC_X86
+#include <immintrin.h>
+#endif
+
+static inline bool IsSync(const uint8_t *buf, int offset, int len)
+{
+  int packets = 0;
+  for (int pos = offset; pos < len && packets < TS_SYNC_PACKETS; pos += TS_SIZE, packets++)
+  {
+    if (buf[pos] != TS_SYNC_BYTE)
+      return false;
+  }
+  return packets >= 2;
+}
+
+static int ScanScalar(const uint8_t *buf, int offset, int len)
+{
+  for (; offset < len - TS_SIZE; offset++)
+  {
+    if (IsSync(buf, offset, len))
+      return offset;
+  }
+  return len - TS_SIZE;
+}
+
+#ifdef TSSYNC_X86
+
+#ifdef __SSE2__
+static int ScanSSE2(const uint8_t *buf, int offset, int len)
+{
+  const __m128i sync = _mm_set1_epi8(TS_SYNC_BYTE);
+  for (; offset + (TS_SYNC_PACKETS-1)*TS_SIZE + 16 <= len; offset += 16)
+  {
+    __m128i match = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + offset)), sync);
+    for (int i = 1; i < TS_SYNC_PACKETS; i++)
+      match = _mm_and_si128(match, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + offset + i*TS_SIZE)), sync));
+    int mask = _mm_movemask_epi8(match);
+    if (mask)
+      return offset + __builtin_ctz(mask);
+  }
+  return ScanScalar(buf, offset, len);
+}
+#endif
+
+__attribute__((target("avx2")))
+static int ScanAVX2(const uint8_t *buf, int offset, int len)
+{
+  const __m256i sync = _mm256_set1_epi8(TS_SYNC_BYTE);
+  for (; offset + (TS_SYNC_PACKETS-1)*TS_SIZE + 32 <= len; offset += 32)
+  {
+    __m256i match = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + offset)), sync);
+    for (int i = 1; i < TS_SYNC_PACKETS; i++)
+      match = _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + offset + i*TS_SIZE)), sync));
+    unsigned int mask = _mm256_movemask_epi8(match);
+    if (mask)
+      return offset + __builtin_ctz(mask);
+  }
+  return ScanScalar(buf, offset, len);
+}
+
+typedef int (*ScanFunc)(const uint8_t *buf, int offset, int len);
+
+static ScanFunc GetScanFunc()
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return ScanAVX2;
+#ifdef __SSE2__
+  return ScanSSE2;
+#else
+  return ScanScalar;
+#endif
+}
+
+static const ScanFunc Scan = GetScanFunc();
+
+#else
+
+#define Scan ScanScalar
+
+#endif
+
+int TsSyncOffset(const uint8_t *buf, int len)
+{
+  if (len <= TS_SIZE)
+    return 0;
+
+  // usual case, we are in sync already
+  if (IsSync(buf, 0, len))
+    return 0;
+
+  return Scan(buf, 1, len);
+}
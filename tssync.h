@@ -0,0 +1,42 @@
+/*
+ *      vdr-plugin-vnsi - KODI server plugin for VDR
+ *
+ *      Copyright (C) 2005-2012 Team XBMC
+ *      Copyright (C) 2015 Team KODI
+ *
+ *      http://kodi.tv
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with KODI; see the file COPYING.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef VNSI_TSSYNC_H
+#define VNSI_TSSYNC_H
+
+#include <stdint.h>
+
+// number of consecutive packets the sync byte has to be found at
+#define TS_SYNC_PACKETS 3
+
+/*!
+ * Returns the first offset in buf at which the TS sync byte is found for
+ * TS_SYNC_PACKETS consecutive packets (fewer if len does not cover them,
+ * but at least two). If there is no such offset, len - TS_SIZE is returned
+ * and the caller has to check the sync byte at that position itself.
+ */
+int TsSyncOffset(const uint8_t *buf, int len);
+
+#endif // VNSI_TSSYNC_H
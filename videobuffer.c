@@ -26,81 +26,314 @@
 #include "config.h"
 #include "vnsi.h"
 #include "recplayer.h"
+#include "tssync.h"
+#include "timeshiftindex.h"
+#include "timeshiftexport.h"
+#include "iopriority.h"
 
-#include <vdr/ringbuffer.h>
 #include <vdr/remux.h>
 #include <vdr/videodir.h>
 #include <vdr/recording.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <fcntl.h>
+#include <algorithm>
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+// number of bytes of consecutive TS packets starting at buf, the first
+// packet is expected to be aligned already
+static int PacketSpan(const uint8_t *buf, off_t readBytes, unsigned int size)
+{
+  if (readBytes > size)
+    readBytes = size;
+
+  int len = TS_SIZE;
+  while (len + TS_SIZE <= readBytes && buf[len] == TS_SYNC_BYTE)
+    len += TS_SIZE;
+  return len;
+}
+
+// Live ring without timeshift. It is sized to hold LiveBufferSeconds of the
+// ingest bitrate, measured as data comes in, so a high bitrate mux rides
+// out the same socket stall as a radio channel. Producer and reader only
+// share the atomic head and tail, both count bytes since the start. The
+// producer prepares a resize and the reader installs the new ring with its
+// next ReadBlock, m_Mutex is taken only while one is pending: meanwhile new
+// data is staged in the new ring behind the head it started from.
+#define LIVERING_MIN_SIZE  KILOBYTE(256)
+#define LIVERING_INIT_SIZE MEGABYTE(1)
+#define LIVERING_MAX_SIZE  MEGABYTE(64)
+#define LIVERING_RATE_TIME 500
 
 class cVideoBufferSimple : public cVideoBuffer
 {
 friend class cVideoBuffer;
+friend class cVideoBufferLive;
 public:
+  virtual ~cVideoBufferSimple();
   virtual void Put(const uint8_t *buf, unsigned int size);
   virtual int ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime);
+  bool Congested();
 
 protected:
   cVideoBufferSimple();
-  cRingBufferLinear m_Buffer;
+  void Measure(unsigned int size);
+  bool Resize(unsigned int size);
+  bool PutStaged(const uint8_t *buf, unsigned int size);
+  void Install();
+  cMutex m_Mutex;
+  uint8_t *m_Data;
+  unsigned int m_Size;
+  uint8_t *m_NewData;
+  unsigned int m_NewSize;
+  uint64_t m_NewHead;
+  std::atomic<bool> m_Resizing;
+  std::atomic<uint64_t> m_Head;
+  std::atomic<uint64_t> m_Tail;
+  uint8_t m_Bounce[TS_SIZE*2];
   int m_BytesConsumed;
+  cTimeMs m_RateTimer;
+  uint64_t m_RateBytes;
+  unsigned int m_Rate;
+  bool m_Overflow;
 };
 
+// copies size bytes to stream position pos of a ring
+static void RingCopy(uint8_t *ring, unsigned int ringSize, uint64_t pos, const uint8_t *buf, unsigned int size)
+{
+  unsigned int offset = pos % ringSize;
+  unsigned int bytes = std::min(ringSize - offset, size);
+  memcpy(ring + offset, buf, bytes);
+  memcpy(ring, buf + bytes, size - bytes);
+}
+
 cVideoBufferSimple::cVideoBufferSimple()
-  :m_Buffer(MEGABYTE(5), TS_SIZE * 2, false)
 {
-  m_Buffer.SetTimeouts(0, 100);
+  m_Data = (uint8_t*)malloc(LIVERING_INIT_SIZE);
+  m_Size = m_Data ? LIVERING_INIT_SIZE : 0;
+  m_NewData = NULL;
+  m_NewSize = 0;
+  m_NewHead = 0;
+  m_Resizing = false;
+  m_Head = 0;
+  m_Tail = 0;
   m_BytesConsumed = 0;
+  m_RateBytes = 0;
+  m_Rate = 0;
+  m_Overflow = false;
+}
+
+cVideoBufferSimple::~cVideoBufferSimple()
+{
+  free(m_Data);
+  free(m_NewData);
+}
+
+// follows a rising bitrate at once and a falling one slowly
+void cVideoBufferSimple::Measure(unsigned int size)
+{
+  m_RateBytes += size;
+  uint64_t elapsed = m_RateTimer.Elapsed();
+  if (elapsed < LIVERING_RATE_TIME)
+    return;
+
+  unsigned int rate = m_RateBytes * 1000 / elapsed;
+  m_Rate = rate > m_Rate ? rate : m_Rate - (m_Rate - rate) / 8;
+  m_RateBytes = 0;
+  m_RateTimer.Set(0);
+
+  // m_Size belongs to the reader until it installed the pending ring
+  if (m_Resizing.load(std::memory_order_acquire))
+    return;
+
+  uint64_t target = (uint64_t)m_Rate * LiveBufferSeconds;
+  if (target < LIVERING_MIN_SIZE)
+    target = LIVERING_MIN_SIZE;
+  else if (target > LIVERING_MAX_SIZE)
+    target = LIVERING_MAX_SIZE;
+  uint64_t fill = m_Head.load(std::memory_order_relaxed) - m_Tail.load(std::memory_order_acquire);
+  if (target > m_Size || (target < m_Size / 2 && fill < target / 2))
+    Resize(target);
+}
+
+// producer, no resize may be pending
+bool cVideoBufferSimple::Resize(unsigned int size)
+{
+  uint64_t head = m_Head.load(std::memory_order_relaxed);
+  if (size < head - m_Tail.load(std::memory_order_acquire))
+    return false;
+  uint8_t *data = (uint8_t*)malloc(size);
+  if (!data)
+    return false;
+
+  cMutexLock lock(&m_Mutex);
+  m_NewData = data;
+  m_NewSize = size;
+  m_NewHead = head;
+  m_Resizing.store(true, std::memory_order_release);
+  return true;
+}
+
+// the reader may install the new ring any time, so decide under the lock
+// which ring takes the data
+bool cVideoBufferSimple::PutStaged(const uint8_t *buf, unsigned int size)
+{
+  cMutexLock lock(&m_Mutex);
+
+  uint64_t tail = m_Tail.load(std::memory_order_acquire);
+  if (!m_Resizing.load(std::memory_order_relaxed))
+  {
+    uint64_t head = m_Head.load(std::memory_order_relaxed);
+    if (head - tail + size > m_Size)
+      return false;
+    RingCopy(m_Data, m_Size, head, buf, size);
+    m_Head.store(head + size, std::memory_order_release);
+    return true;
+  }
+
+  if (m_NewHead - tail + size > m_NewSize)
+    return false;
+  RingCopy(m_NewData, m_NewSize, m_NewHead, buf, size);
+  m_NewHead += size;
+  return true;
+}
+
+// reader, takes over the ring the producer prepared
+void cVideoBufferSimple::Install()
+{
+  cMutexLock lock(&m_Mutex);
+
+  // the head stands still while a resize is pending
+  uint64_t head = m_Head.load(std::memory_order_relaxed);
+  uint64_t pos = m_Tail.load(std::memory_order_relaxed);
+  while (pos < head)
+  {
+    unsigned int offset = pos % m_Size;
+    unsigned int bytes = std::min((uint64_t)(m_Size - offset), head - pos);
+    RingCopy(m_NewData, m_NewSize, pos, m_Data + offset, bytes);
+    pos += bytes;
+  }
+
+  free(m_Data);
+  m_Data = m_NewData;
+  m_Size = m_NewSize;
+  m_NewData = NULL;
+  m_Head.store(m_NewHead, std::memory_order_release);
+  m_Resizing.store(false, std::memory_order_release);
+  DEBUGLOG("live buffer resized to %u bytes", m_Size);
 }
 
 void cVideoBufferSimple::Put(const uint8_t *buf, unsigned int size)
 {
-  m_Buffer.Put(buf, size);
+  Measure(size);
+
+  bool stored;
+  if (m_Resizing.load(std::memory_order_acquire))
+    stored = PutStaged(buf, size);
+  else
+  {
+    uint64_t head = m_Head.load(std::memory_order_relaxed);
+    uint64_t fill = head - m_Tail.load(std::memory_order_acquire);
+
+    // before the bitrate is known, grow instead of dropping
+    if (fill + size > m_Size && !m_Rate && m_Size < LIVERING_MAX_SIZE &&
+        Resize(std::min(std::max((uint64_t)m_Size * 2, fill + size), (uint64_t)LIVERING_MAX_SIZE)))
+      stored = PutStaged(buf, size);
+    else if ((stored = fill + size <= m_Size))
+    {
+      RingCopy(m_Data, m_Size, head, buf, size);
+      m_Head.store(head + size, std::memory_order_release);
+    }
+  }
+
+  if (!stored)
+  {
+    m_OverflowCount++;
+    if (!m_Overflow)
+      ERRORLOG("Live buffer full, dropping data (%u times)", m_OverflowCount);
+    m_Overflow = true;
+    return;
+  }
+  m_Overflow = false;
+  m_DataEvent.Notify(size);
+}
+
+// the reader is falling behind
+bool cVideoBufferSimple::Congested()
+{
+  uint64_t tail = m_Tail.load(std::memory_order_acquire);
+  if (!m_Resizing.load(std::memory_order_acquire))
+    return m_Head.load(std::memory_order_relaxed) - tail > m_Size / 2;
+
+  cMutexLock lock(&m_Mutex);
+  if (!m_Resizing.load(std::memory_order_relaxed))
+    return m_Head.load(std::memory_order_relaxed) - tail > m_Size / 2;
+  return m_NewHead - tail > m_NewSize / 2;
 }
 
 int cVideoBufferSimple::ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime)
 {
-  int  readBytes;
+  uint64_t tail = m_Tail.load(std::memory_order_relaxed) + m_BytesConsumed;
   if (m_BytesConsumed)
-  {
-    m_Buffer.Del(m_BytesConsumed);
-  }
+    m_Tail.store(tail, std::memory_order_release);
   m_BytesConsumed = 0;
-  *buf = m_Buffer.Get(readBytes);
-  if (!(*buf) || readBytes < TS_SIZE)
+  if (m_Resizing.load(std::memory_order_acquire))
+    Install();
+
+  unsigned int readBytes = std::min(m_Head.load(std::memory_order_acquire) - tail, (uint64_t)m_Size);
+  if (readBytes < TS_SIZE)
   {
-    usleep(100);
     return 0;
   }
-  /* Make sure we are looking at a TS packet */
-  while (readBytes > TS_SIZE)
+
+  // a packet across the end of the ring goes through the bounce buffer
+  unsigned int readPos = tail % m_Size;
+  unsigned int contiguous = m_Size - readPos;
+  if (contiguous >= readBytes || contiguous >= sizeof(m_Bounce))
   {
-    if ((*buf)[0] == TS_SYNC_BYTE && (*buf)[TS_SIZE] == TS_SYNC_BYTE)
-      break;
-    m_BytesConsumed++;
-    (*buf)++;
-    readBytes--;
+    *buf = m_Data + readPos;
+    if (readBytes > contiguous)
+      readBytes = contiguous;
+  }
+  else
+  {
+    if (readBytes > sizeof(m_Bounce))
+      readBytes = sizeof(m_Bounce);
+    memcpy(m_Bounce, m_Data + readPos, contiguous);
+    memcpy(m_Bounce + contiguous, m_Data, readBytes - contiguous);
+    *buf = m_Bounce;
   }
 
+  // Make sure we are looking at a TS packet
+  int offset = Resync(*buf, readBytes);
+  m_BytesConsumed += offset;
+  (*buf) += offset;
+  readBytes -= offset;
+
   if ((*buf)[0] != TS_SYNC_BYTE)
   {
-    m_Buffer.Del(m_BytesConsumed);
-    m_BytesConsumed = 0;
     return 0;
   }
 
-  m_BytesConsumed += TS_SIZE;
+  int len = PacketSpan(*buf, readBytes, size);
+  m_BytesConsumed += len;
   endTime = 0;
   wrapTime = 0;
-  return TS_SIZE;
+  return len;
 }
 
 //-----------------------------------------------------------------------------
 
 #define MARGIN 40000
+#define VIDEOBUFFER_CHUNK_SIZE MEGABYTE(2)
+#define VIDEOBUFFER_POOL_CACHE 8
 
 class cVideoBufferTimeshift : public cVideoBuffer
 {
@@ -111,15 +344,27 @@ public:
   virtual off_t GetPosCur();
   virtual void GetPositions(off_t *cur, off_t *min, off_t *max);
   virtual bool HasBuffer() { return true; };
+  virtual void SetVideoPid(int pid, int type);
+  virtual bool FindKeyframe(int64_t pts, off_t *pos);
+  virtual bool LastKeyframe(off_t *pos);
+  virtual bool Export(time_t start, time_t end, const cChannel *channel, const char *name);
+  virtual bool IsReadable(uint64_t pos) { return pos >= GetReadable(); };
 
 protected:
   cVideoBufferTimeshift();
+  virtual ~cVideoBufferTimeshift();
   virtual bool Init() = 0;
   virtual off_t Available();
-  off_t m_BufferSize;
-  off_t m_WritePtr;
-  off_t m_ReadPtr;
-  bool m_BufferFull;
+  uint64_t GetOldest();
+  virtual uint64_t GetReadable();
+  void StopExport();
+  cTimeshiftIndex m_Index;
+  cTimeshiftExport *m_Export;
+  std::atomic<uint64_t> m_Head;
+  std::atomic<off_t> m_BufferSize;
+  std::atomic<off_t> m_WritePtr;
+  std::atomic<off_t> m_ReadPtr;
+  std::atomic<bool> m_BufferFull;
   unsigned int m_Margin;
   unsigned int m_BytesConsumed;
   cMutex m_Mutex;
@@ -131,7 +376,14 @@ cVideoBufferTimeshift::cVideoBufferTimeshift()
   m_BufferFull = false;
   m_ReadPtr = 0;
   m_WritePtr = 0;
+  m_Head = 0;
   m_BytesConsumed = 0;
+  m_Export = NULL;
+}
+
+cVideoBufferTimeshift::~cVideoBufferTimeshift()
+{
+  StopExport();
 }
 
 off_t cVideoBufferTimeshift::GetPosMin()
@@ -173,6 +425,82 @@ void cVideoBufferTimeshift::GetPositions(off_t *cur, off_t *min, off_t *max)
   *max = GetPosMax();
 }
 
+void cVideoBufferTimeshift::SetVideoPid(int pid, int type)
+{
+  m_Index.SetVideoPid(pid, type);
+}
+
+// m_Head counts all bytes written, the oldest data still in the buffer is
+// as far behind as the buffer is long
+uint64_t cVideoBufferTimeshift::GetOldest()
+{
+  off_t min = GetPosMin();
+  off_t max = cVideoBufferTimeshift::GetPosMax();
+  return m_Head.load(std::memory_order_acquire) - (max - min);
+}
+
+bool cVideoBufferTimeshift::FindKeyframe(int64_t pts, off_t *pos)
+{
+  cMutexLock lock(&m_Mutex);
+
+  return m_Index.Find(pts, GetOldest(), pos);
+}
+
+bool cVideoBufferTimeshift::LastKeyframe(off_t *pos)
+{
+  cMutexLock lock(&m_Mutex);
+
+  return m_Index.Last(GetOldest(), pos);
+}
+
+// oldest data ReadAt can copy before the producer overwrites it, which may
+// be a write of up to one chunk ahead of the published head
+uint64_t cVideoBufferTimeshift::GetReadable()
+{
+  return GetOldest() + VIDEOBUFFER_CHUNK_SIZE;
+}
+
+bool cVideoBufferTimeshift::Export(time_t start, time_t end, const cChannel *channel, const char *name)
+{
+  cMutexLock lock(&m_Mutex);
+
+  if (m_Export && m_Export->Active())
+  {
+    ERRORLOG("Export - already running");
+    return false;
+  }
+  delete m_Export;
+  m_Export = NULL;
+
+  time_t now = time(NULL);
+  if (end > now)
+    end = now;
+
+  uint64_t from, to;
+  time_t startTime;
+  if (!m_Index.Range(start, end, GetReadable(), &from, &to, &startTime))
+  {
+    ERRORLOG("Export - range not in timeshift buffer");
+    return false;
+  }
+  if (!to)
+    to = m_Head.load(std::memory_order_acquire);
+  if (to <= from)
+    return false;
+
+  m_Export = new cTimeshiftExport(this, from, to, startTime, end, channel, name,
+                                  m_Index.GetPid(), m_Index.GetType());
+  m_Export->Start();
+  return true;
+}
+
+// derived buffers call this first, the export reads from their storage
+void cVideoBufferTimeshift::StopExport()
+{
+  delete m_Export;
+  m_Export = NULL;
+}
+
 off_t cVideoBufferTimeshift::Available()
 {
   cMutexLock lock(&m_Mutex);
@@ -187,6 +515,132 @@ off_t cVideoBufferTimeshift::Available()
 }
 //-----------------------------------------------------------------------------
 
+cVideoBufferPool::cVideoBufferPool()
+{
+  m_Used = 0;
+  m_Users = 0;
+}
+
+cVideoBufferPool &cVideoBufferPool::Instance()
+{
+  static cVideoBufferPool pool;
+  return pool;
+}
+
+int64_t cVideoBufferPool::Budget()
+{
+  return (int64_t)TimeshiftMemoryBudget*100*1000*1000 / VIDEOBUFFER_CHUNK_SIZE;
+}
+
+uint8_t *cVideoBufferPool::Alloc(bool force)
+{
+  cMutexLock lock(&m_Mutex);
+
+  int64_t budget = Budget();
+  if (!force && budget && m_Used >= budget)
+    return NULL;
+
+  uint8_t *chunk;
+  if (!m_Cache.empty())
+  {
+    chunk = m_Cache.back();
+    m_Cache.pop_back();
+  }
+  else
+  {
+    // aligned to its size, so that it can be backed by huge pages
+    uint8_t *addr = (uint8_t*)mmap(NULL, 2*VIDEOBUFFER_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+      ERRORLOG("Could not allocate timeshift buffer chunk");
+      return NULL;
+    }
+    chunk = (uint8_t*)(((uintptr_t)addr + VIDEOBUFFER_CHUNK_SIZE - 1) & ~(uintptr_t)(VIDEOBUFFER_CHUNK_SIZE - 1));
+    if (chunk > addr)
+      munmap(addr, chunk - addr);
+    if (chunk < addr + VIDEOBUFFER_CHUNK_SIZE)
+      munmap(chunk + VIDEOBUFFER_CHUNK_SIZE, addr + VIDEOBUFFER_CHUNK_SIZE - chunk);
+#ifdef MADV_HUGEPAGE
+    madvise(chunk, VIDEOBUFFER_CHUNK_SIZE, MADV_HUGEPAGE);
+#endif
+  }
+  m_Used++;
+  return chunk;
+}
+
+void cVideoBufferPool::Free(uint8_t *chunk)
+{
+  cMutexLock lock(&m_Mutex);
+
+  m_Used--;
+  if (m_Cache.size() < VIDEOBUFFER_POOL_CACHE)
+    m_Cache.push_back(chunk);
+  else
+    munmap(chunk, VIDEOBUFFER_CHUNK_SIZE);
+}
+
+// memory allocated elsewhere, accounted in chunks
+bool cVideoBufferPool::Reserve(size_t size, bool force)
+{
+  cMutexLock lock(&m_Mutex);
+
+  int64_t chunks = (size + VIDEOBUFFER_CHUNK_SIZE - 1) / VIDEOBUFFER_CHUNK_SIZE;
+  int64_t budget = Budget();
+  if (!force && budget && m_Used + chunks > budget)
+    return false;
+  m_Used += chunks;
+  return true;
+}
+
+void cVideoBufferPool::Release(size_t size)
+{
+  cMutexLock lock(&m_Mutex);
+  m_Used -= (size + VIDEOBUFFER_CHUNK_SIZE - 1) / VIDEOBUFFER_CHUNK_SIZE;
+}
+
+void cVideoBufferPool::Attach()
+{
+  cMutexLock lock(&m_Mutex);
+  m_Users++;
+}
+
+void cVideoBufferPool::Detach()
+{
+  cMutexLock lock(&m_Mutex);
+  m_Users--;
+}
+
+bool cVideoBufferPool::Exhausted()
+{
+  cMutexLock lock(&m_Mutex);
+
+  int64_t budget = Budget();
+  return budget && m_Used >= budget;
+}
+
+// true if the pool is exhausted and a buffer holding this many chunks
+// has at least its share of the budget
+bool cVideoBufferPool::OverShare(size_t chunks)
+{
+  cMutexLock lock(&m_Mutex);
+
+  int64_t budget = Budget();
+  if (!budget || m_Used < budget)
+    return false;
+  return (int64_t)chunks >= budget / (m_Users > 0 ? m_Users : 1);
+}
+
+//-----------------------------------------------------------------------------
+
+// Single producer (receiver thread) / single consumer (streamer thread) ring.
+// The producer owns m_WritePtr, the consumer m_ReadPtr, both are published
+// with release semantics after the data they cover was written or read.
+// The ring is made of pool chunks and grows by one chunk whenever the
+// producer reaches its end, up to the configured size. It only changes
+// size while the reader is behind the producer, i.e. not in the part of
+// the ring which is added or cut off. An export copies without a lock: the
+// producer publishes the mapping of positions under a sequence count, and
+// chunks cut off are only given back once no copy is running.
 class cVideoBufferRAM : public cVideoBufferTimeshift
 {
 friend class cVideoBuffer;
@@ -194,90 +648,304 @@ public:
   virtual void Put(const uint8_t *buf, unsigned int size);
   virtual int ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime);
   virtual void SetPos(off_t pos);
+  virtual bool ReadAt(uint64_t pos, uint8_t *buf, unsigned int size);
 
 protected:
   cVideoBufferRAM();
   virtual ~cVideoBufferRAM();
   virtual bool Init();
-  uint8_t *m_Buffer;
-  uint8_t *m_BufferPtr;
+  virtual off_t Available();
+  virtual uint64_t GetReadable();
+  struct sLap
+  {
+    uint64_t head;
+    off_t writePtr;
+    uint64_t lapStart;
+    off_t lapSize;
+    off_t bufferSize;
+  };
+  void GetLap(sLap &lap);
+  uint64_t GetReadable(const sLap &lap);
+  void BeginUpdate();
+  void EndUpdate();
+  void NextChunk(off_t chunkEnd, off_t writePtr);
+  void ReleaseCut();
+  std::vector<uint8_t*> m_Chunks;
+  uint8_t *m_Bounce;
+  std::atomic<uint64_t> m_LapStart;
+  std::atomic<off_t> m_LapSize;
+  std::atomic<uint32_t> m_Seq;
+  std::atomic<int> m_Copying;
 };
 
 cVideoBufferRAM::cVideoBufferRAM()
 {
-  m_Buffer = 0;
+  m_Bounce = 0;
+  m_LapStart = 0;
+  m_LapSize = 0;
+  m_Seq = 0;
+  m_Copying = 0;
+  cVideoBufferPool::Instance().Attach();
 }
 
 cVideoBufferRAM::~cVideoBufferRAM()
 {
-  free(m_Buffer);
+  StopExport();
+  cVideoBufferPool &pool = cVideoBufferPool::Instance();
+  for (size_t i = 0; i < m_Chunks.size(); i++)
+  {
+    if (m_Chunks[i])
+      pool.Free(m_Chunks[i]);
+  }
+  pool.Detach();
+  free(m_Bounce);
 }
 
 bool cVideoBufferRAM::Init()
 {
-  m_BufferSize = (off_t)TimeshiftBufferSize*100*1000*1000;
-  INFOLOG("allocated timeshift buffer with size: %ld", m_BufferSize);
-  m_Buffer = (uint8_t*)malloc(m_BufferSize + m_Margin);
-  m_BufferPtr = m_Buffer + m_Margin;
-  if (!m_Buffer)
+  size_t chunks = (off_t)TimeshiftBufferSize*100*1000*1000 / VIDEOBUFFER_CHUNK_SIZE;
+  if (chunks < 1)
+    chunks = 1;
+  INFOLOG("allocated timeshift buffer with max size: %ld", (long)(chunks * VIDEOBUFFER_CHUNK_SIZE));
+  m_Chunks.resize(chunks, NULL);
+  m_Bounce = (uint8_t*)malloc(m_Margin);
+  if (!m_Bounce)
     return false;
-  else
-    return true;
+
+  // the first chunk is granted even beyond the budget
+  m_Chunks[0] = cVideoBufferPool::Instance().Alloc(true);
+  if (!m_Chunks[0])
+    return false;
+  m_BufferSize = VIDEOBUFFER_CHUNK_SIZE;
+  return true;
 }
 
 void cVideoBufferRAM::SetPos(off_t pos)
 {
   cMutexLock lock(&m_Mutex);
 
-  m_ReadPtr = pos;
-  if (m_ReadPtr >= m_BufferSize)
-    m_ReadPtr -= m_BufferSize;
+  if (pos >= m_BufferSize)
+    pos -= m_BufferSize;
+  // the window may have been cut back in the meantime
+  if (pos >= m_BufferSize)
+    return;
+  m_ReadPtr.store(pos, std::memory_order_release);
   m_BytesConsumed = 0;
 }
 
+off_t cVideoBufferRAM::Available()
+{
+  off_t writePtr = m_WritePtr.load(std::memory_order_acquire);
+  off_t readPtr = m_ReadPtr.load(std::memory_order_acquire);
+
+  if (readPtr <= writePtr)
+    return writePtr - readPtr;
+  else
+    return m_BufferSize - (readPtr - writePtr);
+}
+
+// called by the producer around changes of what GetLap returns
+void cVideoBufferRAM::BeginUpdate()
+{
+  m_Seq.store(m_Seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void cVideoBufferRAM::EndUpdate()
+{
+  m_Seq.store(m_Seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// consistent view of what the producer published last
+void cVideoBufferRAM::GetLap(sLap &lap)
+{
+  uint32_t seq;
+  do
+  {
+    seq = m_Seq.load(std::memory_order_acquire);
+    lap.head = m_Head.load(std::memory_order_relaxed);
+    lap.writePtr = m_WritePtr.load(std::memory_order_relaxed);
+    lap.lapStart = m_LapStart.load(std::memory_order_relaxed);
+    lap.lapSize = m_LapSize.load(std::memory_order_relaxed);
+    lap.bufferSize = m_BufferSize.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((seq & 1) || seq != m_Seq.load(std::memory_order_relaxed));
+}
+
+// called by the producer before it enters the chunk starting at chunkEnd
+void cVideoBufferRAM::NextChunk(off_t chunkEnd, off_t writePtr)
+{
+  cVideoBufferPool &pool = cVideoBufferPool::Instance();
+  size_t index = chunkEnd / VIDEOBUFFER_CHUNK_SIZE;
+
+  ReleaseCut();
+  if (chunkEnd >= m_BufferSize)
+  {
+    // end of ring, grow or wrap. A reader ahead of the writer would get
+    // the new chunk before it is written, wrap then. The lock keeps a
+    // seek from moving the reader there meanwhile.
+    cMutexLock lock(&m_Mutex);
+    if (m_ReadPtr.load(std::memory_order_acquire) <= writePtr &&
+        index < m_Chunks.size() && !m_Chunks[index] && (m_Chunks[index] = pool.Alloc()))
+    {
+      BeginUpdate();
+      m_BufferSize.store(chunkEnd + VIDEOBUFFER_CHUNK_SIZE, std::memory_order_release);
+      EndUpdate();
+    }
+  }
+  else if (m_ReadPtr.load(std::memory_order_acquire) <= writePtr && pool.OverShare(index))
+  {
+    // other buffers are short of memory, wrap here and give the rest back
+    cMutexLock lock(&m_Mutex);
+    INFOLOG("timeshift buffer reduced to size: %ld", (long)chunkEnd);
+    BeginUpdate();
+    m_BufferSize.store(chunkEnd, std::memory_order_seq_cst);
+    EndUpdate();
+    ReleaseCut();
+  }
+}
+
+// gives chunks beyond the end of the ring back, unless an export may still
+// copy from them
+void cVideoBufferRAM::ReleaseCut()
+{
+  size_t index = m_BufferSize.load(std::memory_order_seq_cst) / VIDEOBUFFER_CHUNK_SIZE;
+  if (index >= m_Chunks.size() || !m_Chunks[index] || m_Copying.load(std::memory_order_seq_cst))
+    return;
+
+  cVideoBufferPool &pool = cVideoBufferPool::Instance();
+  for (size_t i = index; i < m_Chunks.size() && m_Chunks[i]; i++)
+  {
+    pool.Free(m_Chunks[i]);
+    m_Chunks[i] = NULL;
+  }
+}
+
 void cVideoBufferRAM::Put(const uint8_t *buf, unsigned int size)
 {
+  // below a write crosses at most one chunk boundary
+  while (size > VIDEOBUFFER_CHUNK_SIZE)
+  {
+    Put(buf, VIDEOBUFFER_CHUNK_SIZE);
+    buf += VIDEOBUFFER_CHUNK_SIZE;
+    size -= VIDEOBUFFER_CHUNK_SIZE;
+  }
+
+  off_t writePtr = m_WritePtr.load(std::memory_order_relaxed);
+  off_t chunkEnd = (writePtr / VIDEOBUFFER_CHUNK_SIZE + 1) * VIDEOBUFFER_CHUNK_SIZE;
+  if (writePtr + size + MARGIN >= chunkEnd)
+    NextChunk(chunkEnd, writePtr);
+
   if (Available() + MARGIN >= m_BufferSize)
   {
     return;
   }
 
-  if ((m_BufferSize - m_WritePtr) <= size)
+  uint64_t head = m_Head.load(std::memory_order_relaxed);
+  m_Index.Put(buf, size, head, writePtr, m_BufferSize);
+  unsigned int writeSize = size;
+  uint64_t lapStart = m_LapStart;
+  off_t lapSize = m_LapSize;
+
+  while (size)
   {
-    int bytes = m_BufferSize - m_WritePtr;
-    memcpy(m_BufferPtr+m_WritePtr, buf, bytes);
-    size -= bytes;
+    unsigned int offset = writePtr % VIDEOBUFFER_CHUNK_SIZE;
+    unsigned int bytes = VIDEOBUFFER_CHUNK_SIZE - offset;
+    if (bytes > size)
+      bytes = size;
+    memcpy(m_Chunks[writePtr / VIDEOBUFFER_CHUNK_SIZE] + offset, buf, bytes);
     buf += bytes;
-    cMutexLock lock(&m_Mutex);
-    m_WritePtr = 0;
+    size -= bytes;
+    head += bytes;
+    writePtr += bytes;
+    if (writePtr >= m_BufferSize)
+    {
+      lapSize = writePtr;
+      lapStart = head;
+      writePtr = 0;
+      if (!m_BufferFull.load(std::memory_order_relaxed))
+      {
+        m_bufferWrapTime = time(NULL);
+        m_BufferFull.store(true, std::memory_order_release);
+      }
+    }
   }
 
-  memcpy(m_BufferPtr+m_WritePtr, buf, size);
+  m_bufferEndTime = time(NULL);
 
-  cMutexLock lock(&m_Mutex);
+  // ReadAt maps positions by these, they change together
+  BeginUpdate();
+  m_Head.store(head, std::memory_order_release);
+  m_WritePtr.store(writePtr, std::memory_order_release);
+  m_LapStart.store(lapStart, std::memory_order_relaxed);
+  m_LapSize.store(lapSize, std::memory_order_relaxed);
+  EndUpdate();
+  m_DataEvent.Notify(writeSize);
+}
 
-  m_WritePtr += size;
-  if (!m_BufferFull)
+// data of the last lap lies between the producer and the end the ring had
+// when it wrapped, minus what the ring was cut back by since
+uint64_t cVideoBufferRAM::GetReadable(const sLap &lap)
+{
+  off_t end = lap.lapSize;
+  if (!end || end > lap.bufferSize)
+    end = lap.bufferSize;
+  off_t begin = lap.writePtr + VIDEOBUFFER_CHUNK_SIZE;
+  if ((off_t)lap.lapStart < end - begin)
+    return 0;
+  return lap.lapStart - (end - begin);
+}
+
+uint64_t cVideoBufferRAM::GetReadable()
+{
+  sLap lap;
+  GetLap(lap);
+  return GetReadable(lap);
+}
+
+bool cVideoBufferRAM::ReadAt(uint64_t pos, uint8_t *buf, unsigned int size)
+{
+  // keeps the chunks of the ring seen here from being given back
+  m_Copying.fetch_add(1, std::memory_order_seq_cst);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  sLap lap;
+  GetLap(lap);
+  uint64_t start = pos;
+  bool ok = pos >= GetReadable(lap) && pos + size <= lap.head;
+  while (ok && size)
   {
-    if ((m_WritePtr + 2*MARGIN) > m_BufferSize)
-    {
-      m_BufferFull = true;
-      time(&m_bufferWrapTime);
-    }
+    off_t ptr = pos >= lap.lapStart ? pos - lap.lapStart : lap.lapSize - (off_t)(lap.lapStart - pos);
+    unsigned int offset = ptr % VIDEOBUFFER_CHUNK_SIZE;
+    unsigned int bytes = VIDEOBUFFER_CHUNK_SIZE - offset;
+    if (bytes > size)
+      bytes = size;
+    if (pos < lap.lapStart && bytes > lap.lapStart - pos)
+      bytes = lap.lapStart - pos;
+    memcpy(buf, m_Chunks[ptr / VIDEOBUFFER_CHUNK_SIZE] + offset, bytes);
+    buf += bytes;
+    pos += bytes;
+    size -= bytes;
   }
+  m_Copying.fetch_sub(1, std::memory_order_release);
 
-  time(&m_bufferEndTime);
+  // the producer does not wait for us, check it did not get to the start
+  // of the copy meanwhile
+  GetLap(lap);
+  return ok && start >= GetReadable(lap);
 }
 
 int cVideoBufferRAM::ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime)
 {
+  off_t readPtr = m_ReadPtr.load(std::memory_order_relaxed);
+
   // move read pointer
   if (m_BytesConsumed)
   {
-    cMutexLock lock(&m_Mutex);
-    m_ReadPtr += m_BytesConsumed;
-    if (m_ReadPtr >= m_BufferSize)
-      m_ReadPtr -= m_BufferSize;
+    readPtr += m_BytesConsumed;
+    if (readPtr >= m_BufferSize)
+      readPtr -= m_BufferSize;
+    m_ReadPtr.store(readPtr, std::memory_order_release);
 
     endTime = m_bufferEndTime;
     wrapTime = m_bufferWrapTime;
@@ -291,76 +959,205 @@ int cVideoBufferRAM::ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime
     return 0;
   }
 
-  // if we are close to end, copy margin to front
-  if (m_ReadPtr > (m_BufferSize - m_Margin))
+  // if we are close to the end of a chunk, copy margin to bounce buffer
+  unsigned int chunkOffset = readPtr % VIDEOBUFFER_CHUNK_SIZE;
+  uint8_t *chunk = m_Chunks[readPtr / VIDEOBUFFER_CHUNK_SIZE];
+  if (chunkOffset > VIDEOBUFFER_CHUNK_SIZE - m_Margin)
   {
-    int bytesToCopy = m_BufferSize - m_ReadPtr;
-    memmove(m_Buffer + (m_Margin - bytesToCopy), m_BufferPtr + m_ReadPtr, bytesToCopy);
-    *buf = m_Buffer + (m_Margin - bytesToCopy);
+    int bytesToCopy = VIDEOBUFFER_CHUNK_SIZE - chunkOffset;
+    off_t next = readPtr + bytesToCopy;
+    if (next >= m_BufferSize)
+      next = 0;
+    memcpy(m_Bounce, chunk + chunkOffset, bytesToCopy);
+    memcpy(m_Bounce + bytesToCopy, m_Chunks[next / VIDEOBUFFER_CHUNK_SIZE], m_Margin - bytesToCopy);
+    *buf = m_Bounce;
+    readBytes = m_Margin;
   }
   else
-    *buf = m_BufferPtr + m_ReadPtr;
-
-  // Make sure we are looking at a TS packet
-  while (readBytes > TS_SIZE)
   {
-    if ((*buf)[0] == TS_SYNC_BYTE && (*buf)[TS_SIZE] == TS_SYNC_BYTE)
-      break;
-    m_BytesConsumed++;
-    (*buf)++;
-    readBytes--;
+    *buf = chunk + chunkOffset;
+    if (readBytes > VIDEOBUFFER_CHUNK_SIZE - chunkOffset)
+      readBytes = VIDEOBUFFER_CHUNK_SIZE - chunkOffset;
   }
 
+  // Make sure we are looking at a TS packet
+  int offset = Resync(*buf, readBytes);
+  m_BytesConsumed += offset;
+  (*buf) += offset;
+  readBytes -= offset;
+
   if ((*buf)[0] != TS_SYNC_BYTE)
   {
     return 0;
   }
 
-  m_BytesConsumed += TS_SIZE;
-  return TS_SIZE;
+  int len = PacketSpan(*buf, readBytes, size);
+  m_BytesConsumed += len;
+  return len;
 }
 
 //-----------------------------------------------------------------------------
 
+// Write-behind: Put only copies into staging chunks from the pool, a writer
+// thread flushes complete chunks to disk in large batches. Staging positions
+// are absolute stream offsets, the file offset is position % m_BufferSize.
+// In RAM+File mode flushed chunks are kept for m_RAMSeconds, reads near live
+// are served from them and only older data is read back from disk.
+#define STAGING_CHUNK_SIZE VIDEOBUFFER_CHUNK_SIZE
+#define STAGING_FLUSH_SIZE MEGABYTE(4)
+#define STAGING_MAX_SIZE   MEGABYTE(64)
+
+class cVideoBufferFile;
+
+class cVideoBufferFileWriter : public cThread
+{
+public:
+  cVideoBufferFileWriter(cVideoBufferFile *buffer);
+  virtual ~cVideoBufferFileWriter();
+  void Signal() { m_Wakeup.Signal(); }
+
+protected:
+  virtual void Action(void);
+  cVideoBufferFile *m_Buffer;
+  cCondWait m_Wakeup;
+};
+
 class cVideoBufferFile : public cVideoBufferTimeshift
 {
 friend class cVideoBuffer;
+friend class cVideoBufferFileWriter;
 public:
   virtual off_t GetPosMax();
   virtual void Put(const uint8_t *buf, unsigned int size);
   virtual int ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime);
   virtual void SetPos(off_t pos);
+  virtual bool ReadAt(uint64_t pos, uint8_t *buf, unsigned int size);
+  virtual int GetFile(uint64_t pos, unsigned int size, off_t *offset);
 
 protected:
   cVideoBufferFile();
-  cVideoBufferFile(int clientID);
+  cVideoBufferFile(int clientID, int ramSeconds = 0);
   virtual ~cVideoBufferFile();
   virtual bool Init();
-  virtual int ReadBytes(uint8_t *buf, off_t pos, unsigned int size);
+  virtual off_t Available();
+  virtual int ReadBytes(uint8_t *buf, off_t pos, unsigned int size, eIOClass ioclass = IOCLASS_PLAYBACK);
+  bool Map();
+  off_t ReadBlockDirect(uint8_t **buf);
+  bool Flush();
+  void ReleaseChunks();
+  uint64_t AbsPos(off_t pos, uint64_t head);
+  uint8_t *StagedChunk(uint64_t pos);
   int m_ClientID;
   cString m_Filename;
   int m_Fd;
+  int m_DirectFd;
+  uint8_t *m_Map;
   uint8_t *m_ReadCache;
   unsigned int m_ReadCachePtr;
   unsigned int m_ReadCacheSize;
   unsigned int m_ReadCacheMaxSize;
+  cVideoBufferFileWriter *m_Writer;
+  std::deque<uint8_t*> m_Staging;
+  std::deque<time_t> m_StagingTime;
+  uint64_t m_StagingStart;
+  uint8_t *m_PutChunk;
+  std::atomic<uint64_t> m_Flushed;
+  uint64_t m_HoldStart, m_HoldEnd;
+  bool m_Overflow;
+  int m_RAMSeconds;
+  bool m_PoolUser;
 };
 
-cVideoBufferFile::cVideoBufferFile()
+cVideoBufferFileWriter::cVideoBufferFileWriter(cVideoBufferFile *buffer)
+  :cThread("VNSI timeshift writer")
+{
+  m_Buffer = buffer;
+}
+
+cVideoBufferFileWriter::~cVideoBufferFileWriter()
+{
+  Cancel(-1);
+  m_Wakeup.Signal();
+  Cancel(5);
+}
+
+void cVideoBufferFileWriter::Action(void)
 {
+  cIOPriority::Set(IOCLASS_TIMESHIFT);
+
+  while (Running())
+  {
+    m_Wakeup.Wait(1000);
+    while (Running() && m_Buffer->Flush())
+      ;
+  }
+}
 
+cVideoBufferFile::cVideoBufferFile()
+{
+  m_RAMSeconds = 0;
+  m_Fd = 0;
+  m_DirectFd = -1;
+  m_Map = NULL;
+  m_Writer = NULL;
+  m_StagingStart = 0;
+  m_PutChunk = NULL;
+  m_Flushed = 0;
+  m_HoldStart = m_HoldEnd = 0;
+  m_Overflow = false;
+  m_PoolUser = false;
 }
 
-cVideoBufferFile::cVideoBufferFile(int clientID)
+cVideoBufferFile::cVideoBufferFile(int clientID, int ramSeconds)
 {
   m_ClientID = clientID;
+  m_RAMSeconds = ramSeconds;
   m_Fd = 0;
+  m_DirectFd = -1;
+  m_Map = NULL;
   m_ReadCacheSize = 0;
   m_ReadCache = 0;
+  m_Writer = NULL;
+  m_StagingStart = 0;
+  m_PutChunk = NULL;
+  m_Flushed = 0;
+  m_HoldStart = m_HoldEnd = 0;
+  m_Overflow = false;
+
+  // staging chunks come from the pool, RAM rings share the budget with them
+  cVideoBufferPool::Instance().Attach();
+  m_PoolUser = true;
 }
 
 cVideoBufferFile::~cVideoBufferFile()
 {
+  StopExport();
+
+  // stop the writer before its chunks go away
+  if (m_Writer)
+  {
+    delete m_Writer;
+    m_Writer = NULL;
+  }
+  for (std::deque<uint8_t*>::iterator it = m_Staging.begin(); it != m_Staging.end(); ++it)
+  {
+    if (*it)
+      cVideoBufferPool::Instance().Free(*it);
+  }
+  m_Staging.clear();
+  m_StagingTime.clear();
+  if (m_PoolUser)
+    cVideoBufferPool::Instance().Detach();
+  if (m_Map)
+  {
+    munmap(m_Map, 2*m_BufferSize);
+    m_Map = NULL;
+  }
+  if (m_DirectFd >= 0)
+  {
+    close(m_DirectFd);
+    m_DirectFd = -1;
+  }
   if (m_Fd)
   {
     close(m_Fd);
@@ -380,7 +1177,9 @@ bool cVideoBufferFile::Init()
   if (!m_ReadCache)
     return false;
 
+  // whole staging chunks, this also makes it whole pages for the mapping
   m_BufferSize = (off_t)TimeshiftBufferFileSize*1000*1000*1000;
+  m_BufferSize = (m_BufferSize + STAGING_CHUNK_SIZE - 1) / STAGING_CHUNK_SIZE * STAGING_CHUNK_SIZE;
 
   struct stat sb;
   if ((*TimeshiftBufferDir) && stat(TimeshiftBufferDir, &sb) == 0 && S_ISDIR(sb.st_mode))
@@ -403,22 +1202,51 @@ bool cVideoBufferFile::Init()
     ERRORLOG("Could not open file: %s", (const char*)m_Filename);
     return false;
   }
-  m_WritePtr = lseek(m_Fd, m_BufferSize - 1, SEEK_SET);
-  if (m_WritePtr == -1)
+  if (ftruncate(m_Fd, m_BufferSize) < 0)
   {
-    ERRORLOG("(Init) Could not seek file: %s", (const char*)m_Filename);
+    ERRORLOG("(Init) Could not resize file: %s", (const char*)m_Filename);
     return false;
   }
-  char tmp = '0';
-  if (safe_write(m_Fd, &tmp, 1) < 0)
+
+  // the writer bypasses the page cache, reads still go through it
+  if (TimeshiftBufferDirectIO)
   {
-    ERRORLOG("(Init) Could not write to file: %s", (const char*)m_Filename);
-    return false;
+    m_DirectFd = open(m_Filename, O_WRONLY | O_DIRECT);
+    if (m_DirectFd == -1)
+      INFOLOG("Direct I/O not supported for file: %s", (const char*)m_Filename);
   }
 
   m_WritePtr = 0;
   m_ReadPtr = 0;
   m_ReadCacheSize = 0;
+
+  if (!Map())
+    INFOLOG("Could not map file: %s, using read cache", (const char*)m_Filename);
+
+  m_Writer = new cVideoBufferFileWriter(this);
+  m_Writer->Start();
+  return true;
+}
+
+bool cVideoBufferFile::Map()
+{
+  // needs twice the size of the file in address space
+  if (sizeof(void*) < 8)
+    return false;
+
+  uint8_t *addr = (uint8_t*)mmap(NULL, 2*m_BufferSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (addr == MAP_FAILED)
+    return false;
+
+  if (mmap(addr, m_BufferSize, PROT_READ, MAP_SHARED | MAP_FIXED, m_Fd, 0) == MAP_FAILED ||
+      mmap(addr + m_BufferSize, m_BufferSize, PROT_READ, MAP_SHARED | MAP_FIXED, m_Fd, 0) == MAP_FAILED)
+  {
+    munmap(addr, 2*m_BufferSize);
+    return false;
+  }
+  madvise(addr, 2*m_BufferSize, MADV_SEQUENTIAL);
+
+  m_Map = addr;
   return true;
 }
 
@@ -436,6 +1264,8 @@ void cVideoBufferFile::SetPos(off_t pos)
 off_t cVideoBufferFile::GetPosMax()
 {
   off_t posMax = cVideoBufferTimeshift::GetPosMax();
+  if (m_Map || m_Writer)
+    return posMax;
   if (posMax >= m_ReadCacheMaxSize)
     posMax -= m_ReadCacheMaxSize;
   else
@@ -443,6 +1273,37 @@ off_t cVideoBufferFile::GetPosMax()
   return posMax;
 }
 
+off_t cVideoBufferFile::Available()
+{
+  off_t writePtr = m_WritePtr.load(std::memory_order_acquire);
+  off_t readPtr = m_ReadPtr.load(std::memory_order_acquire);
+
+  if (readPtr <= writePtr)
+    return writePtr - readPtr;
+  else
+    return m_BufferSize - (readPtr - writePtr);
+}
+
+uint64_t cVideoBufferFile::AbsPos(off_t pos, uint64_t head)
+{
+  off_t writePtr = head % m_BufferSize;
+  if (pos <= writePtr)
+    return head - (writePtr - pos);
+  else
+    return head - (writePtr + m_BufferSize - pos);
+}
+
+// caller holds m_Mutex
+uint8_t *cVideoBufferFile::StagedChunk(uint64_t pos)
+{
+  if (pos < m_StagingStart)
+    return NULL;
+  size_t index = (pos - m_StagingStart) / STAGING_CHUNK_SIZE;
+  if (index >= m_Staging.size())
+    return NULL;
+  return m_Staging[index];
+}
+
 void cVideoBufferFile::Put(const uint8_t *buf, unsigned int size)
 {
   if (Available() + MARGIN >= m_BufferSize)
@@ -450,72 +1311,267 @@ void cVideoBufferFile::Put(const uint8_t *buf, unsigned int size)
     return;
   }
 
-  if ((m_BufferSize - m_WritePtr) <= size)
+  uint64_t head = m_Head.load(std::memory_order_relaxed);
+  uint64_t flushed = m_Flushed.load(std::memory_order_acquire);
+  if (head + size - flushed > STAGING_MAX_SIZE)
   {
-    int bytes = m_BufferSize - m_WritePtr;
+    m_OverflowCount++;
+    if (!m_Overflow)
+      ERRORLOG("Timeshift file can't keep up, dropping data: %s", (const char*)m_Filename);
+    m_Overflow = true;
+    return;
+  }
+  m_Overflow = false;
+
+  m_Index.Put(buf, size, head, head % m_BufferSize, m_BufferSize);
 
-    int p = 0;
-    off_t ptr = m_WritePtr;
-    while(bytes > 0)
+  uint64_t start = head;
+  bool newChunk = false;
+  while (size)
+  {
+    unsigned int offset = head % STAGING_CHUNK_SIZE;
+    if (offset == 0)
     {
-      p = pwrite(m_Fd, buf, bytes, ptr);
-      if (p < 0)
+      uint8_t *chunk = cVideoBufferPool::Instance().Alloc(true);
+      if (!chunk)
       {
-        ERRORLOG("Could not write to file: %s", (const char*)m_Filename);
-        return;
+        ERRORLOG("Could not allocate staging buffer for file: %s", (const char*)m_Filename);
+        break;
       }
-      size -= p;
-      bytes -= p;
-      buf += p;
-      ptr += p;
+      cMutexLock lock(&m_Mutex);
+      if (m_Staging.empty())
+        m_StagingStart = head;
+      m_Staging.push_back(chunk);
+      m_StagingTime.push_back(time(NULL));
+      m_PutChunk = chunk;
+      newChunk = true;
+    }
+    unsigned int bytes = STAGING_CHUNK_SIZE - offset;
+    if (bytes > size)
+      bytes = size;
+    memcpy(m_PutChunk + offset, buf, bytes);
+    buf += bytes;
+    size -= bytes;
+    head += bytes;
+  }
+
+  off_t writePtr = head % m_BufferSize;
+  if (!m_BufferFull)
+  {
+    if (head + 2*MARGIN > (uint64_t)m_BufferSize)
+    {
+      m_BufferFull = true;
+      m_bufferWrapTime = time(NULL);
     }
+  }
+  m_bufferEndTime = time(NULL);
+
+  m_WritePtr.store(writePtr, std::memory_order_release);
+  m_Head.store(head, std::memory_order_release);
+  m_DataEvent.Notify(head - start);
+
+  if (newChunk && head - head % STAGING_CHUNK_SIZE - flushed >= STAGING_FLUSH_SIZE)
+    m_Writer->Signal();
+}
+
+// called by the writer thread, returns true if there may be more to flush
+bool cVideoBufferFile::Flush()
+{
+  uint64_t flushed = m_Flushed.load(std::memory_order_relaxed);
+  uint64_t head = m_Head.load(std::memory_order_acquire);
+  uint64_t end = head - head % STAGING_CHUNK_SIZE;
+  if (end <= flushed)
+    return false;
+
+  // one batch, not crossing the end of the file
+  off_t pos = flushed % m_BufferSize;
+  if (end - flushed > STAGING_FLUSH_SIZE)
+    end = flushed + STAGING_FLUSH_SIZE;
+  if (pos + (off_t)(end - flushed) > m_BufferSize)
+    end = flushed + (m_BufferSize - pos);
+
+  struct iovec iov[STAGING_FLUSH_SIZE / STAGING_CHUNK_SIZE];
+  int count = 0;
+  {
     cMutexLock lock(&m_Mutex);
-    m_WritePtr = 0;
+    for (uint64_t p = flushed; p < end; p += STAGING_CHUNK_SIZE)
+    {
+      iov[count].iov_base = StagedChunk(p);
+      iov[count].iov_len = STAGING_CHUNK_SIZE;
+      count++;
+    }
   }
 
-  off_t ptr = m_WritePtr;
-  int bytes = size;
-  int p;
-  while(bytes > 0)
+  int fd = m_DirectFd >= 0 ? m_DirectFd : m_Fd;
+  struct iovec *vec = iov;
+  size_t bytes = end - flushed;
+  while (bytes > 0)
   {
-    p = pwrite(m_Fd, buf, bytes, ptr);
+    uint64_t start = cIOPriority::Now();
+    ssize_t p = pwritev(fd, vec, count, pos);
+    cIOPriority::Account(IOCLASS_TIMESHIFT, p, start);
     if (p < 0)
     {
+      if (errno == EINTR)
+        continue;
       ERRORLOG("Could not write to file: %s", (const char*)m_Filename);
-      return;
+      return false;
     }
     bytes -= p;
-    buf += p;
-    ptr += p;
+    pos += p;
+    while (p > 0)
+    {
+      if ((size_t)p >= vec->iov_len)
+      {
+        p -= vec->iov_len;
+        vec++;
+        count--;
+      }
+      else
+      {
+        vec->iov_base = (uint8_t*)vec->iov_base + p;
+        vec->iov_len -= p;
+        p = 0;
+      }
+    }
   }
 
+  m_Flushed.store(end, std::memory_order_release);
+  ReleaseChunks();
+  return true;
+}
+
+// free flushed chunks unless the reader still points into them, in RAM+File
+// mode only once the data is older than m_RAMSeconds or memory is short
+void cVideoBufferFile::ReleaseChunks()
+{
   cMutexLock lock(&m_Mutex);
 
-  m_WritePtr += size;
-  if (!m_BufferFull)
+  uint64_t flushed = m_Flushed.load(std::memory_order_relaxed);
+  uint64_t start = m_StagingStart;
+  time_t expire = time(NULL) - m_RAMSeconds;
+  bool exhausted = m_RAMSeconds && cVideoBufferPool::Instance().Exhausted();
+  for (size_t i = 0; i < m_Staging.size() && start + STAGING_CHUNK_SIZE <= flushed; i++, start += STAGING_CHUNK_SIZE)
   {
-    if ((m_WritePtr + 2*MARGIN) > m_BufferSize)
+    // a chunk is as old as the start of the one following it
+    if (m_RAMSeconds && !exhausted && (i + 1 >= m_StagingTime.size() || m_StagingTime[i + 1] > expire))
+      break;
+    if (m_Staging[i] && (start >= m_HoldEnd || start + STAGING_CHUNK_SIZE <= m_HoldStart))
     {
-      m_BufferFull = true;
-      time(&m_bufferWrapTime);
+      cVideoBufferPool::Instance().Free(m_Staging[i]);
+      m_Staging[i] = NULL;
     }
   }
-
-  time(&m_bufferEndTime);
+  while (!m_Staging.empty() && !m_Staging.front())
+  {
+    m_Staging.pop_front();
+    m_StagingTime.pop_front();
+    m_StagingStart += STAGING_CHUNK_SIZE;
+  }
 }
 
-int cVideoBufferFile::ReadBytes(uint8_t *buf, off_t pos, unsigned int size)
+int cVideoBufferFile::ReadBytes(uint8_t *buf, off_t pos, unsigned int size, eIOClass ioclass)
 {
   int p;
-  for (;;)
+  int ret = 0;
+  while (size)
   {
-    p = pread(m_Fd, buf, size, pos);
+    // data still staged is copied, everything else is on disk
+    if (m_Writer)
+    {
+      cMutexLock lock(&m_Mutex);
+      uint64_t abs = AbsPos(pos, m_Head.load(std::memory_order_acquire));
+      uint8_t *chunk = StagedChunk(abs);
+      if (chunk)
+      {
+        unsigned int offset = abs % STAGING_CHUNK_SIZE;
+        p = STAGING_CHUNK_SIZE - offset;
+        if ((unsigned int)p > size)
+          p = size;
+        memcpy(buf, chunk + offset, p);
+        ret += p;
+        buf += p;
+        pos += p;
+        size -= p;
+        continue;
+      }
+    }
+
+    unsigned int bytes = size;
+    if (m_Writer && bytes > STAGING_CHUNK_SIZE - pos % STAGING_CHUNK_SIZE)
+      bytes = STAGING_CHUNK_SIZE - pos % STAGING_CHUNK_SIZE;
+    uint64_t start = cIOPriority::Now();
+    p = pread(m_Fd, buf, bytes, pos);
+    cIOPriority::Account(ioclass, p, start);
     if (p < 0 && errno == EINTR)
     {
       continue;
     }
-    return p;
+    if (p <= 0)
+      return ret ? ret : p;
+    ret += p;
+    buf += p;
+    pos += p;
+    size -= p;
+  }
+  return ret;
+}
+
+bool cVideoBufferFile::ReadAt(uint64_t pos, uint8_t *buf, unsigned int size)
+{
+  if (pos < GetReadable() || pos + size > m_Head.load(std::memory_order_acquire))
+    return false;
+  if (ReadBytes(buf, pos % m_BufferSize, size, IOCLASS_BULK) != (int)size)
+    return false;
+
+  // the writer does not lock, check it did not get here meanwhile
+  return pos >= GetReadable();
+}
+
+// file and offset of data already written to disk, -1 if it's still staged
+int cVideoBufferFile::GetFile(uint64_t pos, unsigned int size, off_t *offset)
+{
+  *offset = pos % m_BufferSize;
+  if (!m_Writer || pos + size > m_Flushed.load(std::memory_order_acquire) ||
+      *offset + size > m_BufferSize)
+    return -1;
+  return m_Fd;
+}
+
+// returns the number of bytes readable in place, 0 if there is not enough
+// data yet and -1 if the data has to go through the read cache
+off_t cVideoBufferFile::ReadBlockDirect(uint8_t **buf)
+{
+  cMutexLock lock(&m_Mutex);
+
+  uint64_t head = m_Head.load(std::memory_order_acquire);
+  uint64_t pos = AbsPos(m_ReadPtr, head);
+  off_t readBytes = head - pos;
+  if (readBytes < m_Margin)
+    return 0;
+
+  uint8_t *chunk = StagedChunk(pos);
+  unsigned int offset = pos % STAGING_CHUNK_SIZE;
+  if (chunk && offset + m_Margin <= STAGING_CHUNK_SIZE)
+  {
+    if (readBytes > STAGING_CHUNK_SIZE - offset)
+      readBytes = STAGING_CHUNK_SIZE - offset;
+    *buf = chunk + offset;
+    m_HoldStart = pos;
+    m_HoldEnd = pos + readBytes;
+    return readBytes;
+  }
+
+  // the second mapping continues the first one, no need to care about wrap
+  uint64_t flushed = m_Flushed.load(std::memory_order_acquire);
+  if (m_Map && !chunk && pos + m_Margin <= flushed)
+  {
+    if (readBytes > (off_t)(flushed - pos))
+      readBytes = flushed - pos;
+    *buf = m_Map + m_ReadPtr;
+    return readBytes;
   }
+  return -1;
 }
 
 int cVideoBufferFile::ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime)
@@ -528,6 +1584,7 @@ int cVideoBufferFile::ReadBlock(uint8_t **buf, unsigned int size, time_t &endTim
     if (m_ReadPtr >= m_BufferSize)
       m_ReadPtr -= m_BufferSize;
     m_ReadCachePtr += m_BytesConsumed;
+    m_HoldStart = m_HoldEnd = 0;
 
     endTime = m_bufferEndTime;
     wrapTime = m_bufferWrapTime;
@@ -535,80 +1592,66 @@ int cVideoBufferFile::ReadBlock(uint8_t **buf, unsigned int size, time_t &endTim
   m_BytesConsumed = 0;
 
   // check if we have anything to read
-  off_t readBytes;
-  if (m_ReadCacheSize && ((m_ReadCachePtr + m_Margin) <= m_ReadCacheSize))
+  off_t readBytes = -1;
+  if (m_Writer)
+    readBytes = ReadBlockDirect(buf);
+
+  if (readBytes == 0)
+  {
+    return 0;
+  }
+  else if (readBytes > 0)
+  {
+    m_ReadCacheSize = 0;
+  }
+  else if (m_ReadCacheSize && ((m_ReadCachePtr + m_Margin) <= m_ReadCacheSize))
   {
     readBytes = m_ReadCacheSize - m_ReadCachePtr;
     *buf = m_ReadCache + m_ReadCachePtr;
   }
-  else if ((readBytes = Available()) >= m_ReadCacheMaxSize)
+  else if ((readBytes = Available()) >= m_Margin)
   {
-    if (m_ReadPtr + m_ReadCacheMaxSize <= m_BufferSize)
+    if (readBytes > m_ReadCacheMaxSize)
+      readBytes = m_ReadCacheMaxSize;
+
+    int bytes = readBytes;
+    if (m_ReadPtr + readBytes > m_BufferSize)
+      bytes = m_BufferSize - m_ReadPtr;
+    int p = ReadBytes(m_ReadCache, m_ReadPtr, bytes);
+    if (p == bytes && bytes < readBytes)
     {
-      m_ReadCacheSize = ReadBytes(m_ReadCache, m_ReadPtr, m_ReadCacheMaxSize);
-      if (m_ReadCacheSize < 0)
-      {
-        ERRORLOG("Could not read file: %s", (const char*)m_Filename);
-        return 0;
-      }
-      if (m_ReadCacheSize < m_Margin)
-      {
-        ERRORLOG("Could not read file (margin): %s , read: %d", (const char*)m_Filename, m_ReadCacheSize);
-        m_ReadCacheSize = 0;
-        return 0;
-      }
-      readBytes = m_ReadCacheSize;
-      *buf = m_ReadCache;
-      m_ReadCachePtr = 0;
+      int p2 = ReadBytes(m_ReadCache + bytes, 0, readBytes - bytes);
+      if (p2 > 0)
+        p += p2;
     }
-    else
+    if (p < (int)m_Margin)
     {
-      m_ReadCacheSize = ReadBytes(m_ReadCache, m_ReadPtr, m_BufferSize - m_ReadPtr);
-      if ((m_ReadCacheSize < m_Margin) && (m_ReadCacheSize != (m_BufferSize - m_ReadPtr)))
-      {
-        ERRORLOG("Could not read file (end): %s", (const char*)m_Filename);
-        m_ReadCacheSize = 0;
-        return 0;
-      }
-      readBytes = ReadBytes(m_ReadCache + m_ReadCacheSize, 0, m_ReadCacheMaxSize - m_ReadCacheSize);
-      if (readBytes < 0)
-      {
-        ERRORLOG("Could not read file (end): %s", (const char*)m_Filename);
-        m_ReadCacheSize = 0;
-        return 0;
-      }
-      m_ReadCacheSize += readBytes;
-      if (m_ReadCacheSize < m_Margin)
-      {
-        ERRORLOG("Could not read file (margin): %s", (const char*)m_Filename);
-        m_ReadCacheSize = 0;
-        return 0;
-      }
-      readBytes = m_ReadCacheSize;
-      *buf = m_ReadCache;
-      m_ReadCachePtr = 0;
+      ERRORLOG("Could not read file (margin): %s , read: %d", (const char*)m_Filename, p);
+      m_ReadCacheSize = 0;
+      return 0;
     }
+    m_ReadCacheSize = p;
+    m_ReadCachePtr = 0;
+    readBytes = m_ReadCacheSize;
+    *buf = m_ReadCache;
   }
   else
     return 0;
 
   // Make sure we are looking at a TS packet
-  while (readBytes > TS_SIZE)
-  {
-    if ((*buf)[0] == TS_SYNC_BYTE && (*buf)[TS_SIZE] == TS_SYNC_BYTE)
-      break;
-    m_BytesConsumed++;
-    (*buf)++;
-    readBytes--;
-  }
+  int offset = Resync(*buf, readBytes);
+  m_BytesConsumed += offset;
+  (*buf) += offset;
+  readBytes -= offset;
 
   if ((*buf)[0] != TS_SYNC_BYTE)
   {
     return 0;
   }
 
-  m_BytesConsumed += TS_SIZE;
-  return TS_SIZE;
+  int len = PacketSpan(*buf, readBytes, size);
+  m_BytesConsumed += len;
+  return len;
 }
 
 //-----------------------------------------------------------------------------
@@ -621,21 +1664,29 @@ public:
   virtual void Put(const uint8_t *buf, unsigned int size);
   virtual int ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime);
   virtual time_t GetRefTime();
+  virtual bool WantsInput() { return false; };
+  virtual bool FindKeyframe(int64_t pts, off_t *pos);
+  virtual bool LastKeyframe(off_t *pos);
 
 protected:
-  cVideoBufferRecording(const cRecording *rec);
+  cVideoBufferRecording(const cRecording *rec, bool live);
   virtual ~cVideoBufferRecording();
   virtual bool Init();
   virtual off_t Available();
   off_t GetPosEnd();
+  bool GetPts(uint64_t pos, int64_t *pts);
   cRecPlayer *m_RecPlayer;
   const cRecording *m_Recording;
   cTimeMs m_ScanTimer;
+  bool m_Live;
+  int64_t m_FirstPts;
 };
 
-cVideoBufferRecording::cVideoBufferRecording(const cRecording *rec)
+cVideoBufferRecording::cVideoBufferRecording(const cRecording *rec, bool live)
 {
   m_Recording = rec;
+  m_Live = live;
+  m_FirstPts = -1;
   m_ReadCacheSize = 0;
   m_ReadCache = 0;
 }
@@ -677,6 +1728,11 @@ bool cVideoBufferRecording::Init()
   m_InputAttached = false;
   m_ScanTimer.Set(0);
 
+  // timeshift on a running recording, start at its last I-frame
+  off_t pos;
+  if (m_Live && LastKeyframe(&pos))
+    m_ReadPtr = pos;
+
   return true;
 }
 
@@ -685,6 +1741,79 @@ time_t cVideoBufferRecording::GetRefTime()
   return m_Recording->Start();
 }
 
+bool cVideoBufferRecording::GetPts(uint64_t pos, int64_t *pts)
+{
+  uint8_t buf[TS_SIZE*32];
+  int len = m_RecPlayer->getBlock(buf, pos, sizeof(buf));
+  if (len <= 0)
+    return false;
+
+  for (int i = TsSyncOffset(buf, len); i + TS_SIZE <= len; i += TS_SIZE)
+  {
+    const uint8_t *p = buf + i;
+    if (p[0] != TS_SYNC_BYTE || !TsPayloadStart(p))
+      continue;
+    int offset = TsPayloadOffset(p);
+    if (offset + 14 > TS_SIZE)
+      continue;
+    const uint8_t *pes = p + offset;
+    if (pes[0] || pes[1] || pes[2] != 1 || (pes[3] & 0xF0) != 0xE0)
+      continue;
+    if (!PesHasPts(pes))
+      continue;
+    *pts = PesGetPts(pes);
+    return true;
+  }
+  return false;
+}
+
+bool cVideoBufferRecording::FindKeyframe(int64_t pts, off_t *pos)
+{
+  if (m_FirstPts < 0 && !GetPts(0, &m_FirstPts))
+  {
+    m_FirstPts = -1;
+    return false;
+  }
+
+  // frames are evenly spaced, the index of the recording maps them to
+  // file positions
+  const int64_t mask = (1LL << 33) - 1;
+  int64_t delta = (pts - m_FirstPts) & mask;
+  if (delta > (1LL << 32))
+    delta = 0;
+
+  m_RecPlayer->reScan();
+  uint32_t frames = m_RecPlayer->getLengthFrames();
+  if (!frames)
+    return false;
+  uint64_t target = delta * m_Recording->FramesPerSecond() / 90000;
+  if (target >= frames)
+    return false;
+
+  uint64_t iframePos;
+  uint32_t frame, length;
+  if (!m_RecPlayer->getNextIFrame(target, 0, &iframePos, &frame, &length) &&
+      !m_RecPlayer->getNextIFrame(target, 1, &iframePos, &frame, &length))
+    return false;
+
+  *pos = iframePos;
+  return true;
+}
+
+bool cVideoBufferRecording::LastKeyframe(off_t *pos)
+{
+  uint64_t iframePos;
+  uint32_t frame, length;
+
+  m_RecPlayer->reScan();
+  uint32_t frames = m_RecPlayer->getLengthFrames();
+  if (!frames || !m_RecPlayer->getNextIFrame(frames - 1, 0, &iframePos, &frame, &length))
+    return false;
+
+  *pos = iframePos;
+  return true;
+}
+
 off_t cVideoBufferRecording::Available()
 {
   if (m_ScanTimer.TimedOut())
@@ -743,24 +1872,21 @@ int cVideoBufferRecording::ReadBlock(uint8_t **buf, unsigned int size, time_t &e
     return 0;
 
   // Make sure we are looking at a TS packet
-  while (readBytes > TS_SIZE)
-  {
-    if ((*buf)[0] == TS_SYNC_BYTE && (*buf)[TS_SIZE] == TS_SYNC_BYTE)
-      break;
-    m_BytesConsumed++;
-    (*buf)++;
-    readBytes--;
-  }
+  int offset = Resync(*buf, readBytes);
+  m_BytesConsumed += offset;
+  (*buf) += offset;
+  readBytes -= offset;
 
   if ((*buf)[0] != TS_SYNC_BYTE)
   {
     return 0;
   }
 
-  m_BytesConsumed += TS_SIZE;
+  int len = PacketSpan(*buf, readBytes, size);
+  m_BytesConsumed += len;
   time(&endTime);
   wrapTime = 0;
-  return TS_SIZE;
+  return len;
 }
 
 //-----------------------------------------------------------------------------
@@ -771,6 +1897,7 @@ friend class cVideoBuffer;
 public:
   virtual off_t GetPosMax();
   virtual void Put(const uint8_t *buf, unsigned int size);
+  virtual bool WantsInput() { return false; };
 
 protected:
   cVideoBufferTest(cString filename);
@@ -846,28 +1973,665 @@ off_t cVideoBufferTest::Available()
 
 //-----------------------------------------------------------------------------
 
-cVideoBuffer::cVideoBuffer()
+// One RAM store per channel, shared by all clients watching it. A single
+// feeder writes, every reader keeps its own absolute position. The feeder
+// is never held up by readers: when the store is full its oldest chunk is
+// reused. A reader still in there gets it cut off, the chunk goes back to
+// the pool once the reader moved on, which then skips forward to the tail.
+// The store never holds more than its size, cut off chunks included.
+class cVideoBufferShared;
+
+class cTimeshiftStore
 {
-  m_CheckEof = false;
-  m_InputAttached = true;
-  m_bufferEndTime = 0;
-  m_bufferWrapTime = 0;
+friend class cVideoBufferShared;
+public:
+  static cTimeshiftStore *Attach(const cChannel *channel, cVideoBufferShared *reader);
+  void Detach(cVideoBufferShared *reader);
+  void Put(cVideoBufferShared *feeder, const uint8_t *buf, unsigned int size);
+
+protected:
+  cTimeshiftStore(const std::string &key);
+  ~cTimeshiftStore();
+  uint8_t *NewChunk(uint64_t head);
+  uint8_t *Chunk(uint64_t pos);
+  bool IsHeld(uint64_t pos);
+  std::string m_Key;
+  cTimeshiftIndex m_Index;
+  cMutex m_Mutex;
+  std::deque<uint8_t*> m_Chunks;
+  std::deque<time_t> m_ChunkTime;
+  std::list<std::pair<uint64_t, uint8_t*> > m_Cut;
+  uint64_t m_Tail;
+  std::atomic<uint64_t> m_Head;
+  std::atomic<time_t> m_EndTime;
+  uint8_t *m_PutChunk;
+  size_t m_MaxChunks;
+  bool m_Overflow;
+  std::list<cVideoBufferShared*> m_Readers;
+  std::atomic<cVideoBufferShared*> m_Feeder;
+  cVideoBufferEvent m_DataEvent;
+  static cMutex m_StoresMutex;
+  static std::map<std::string, cTimeshiftStore*> m_Stores;
+};
+
+class cVideoBufferShared : public cVideoBuffer
+{
+friend class cVideoBuffer;
+friend class cTimeshiftStore;
+public:
+  virtual void Put(const uint8_t *buf, unsigned int size);
+  virtual int ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime);
+  virtual off_t GetPosMin();
+  virtual off_t GetPosMax();
+  virtual off_t GetPosCur();
+  virtual void GetPositions(off_t *cur, off_t *min, off_t *max);
+  virtual void SetPos(off_t pos);
+  virtual bool HasBuffer() { return true; };
+  virtual time_t GetRefTime();
+  virtual void AttachInput(bool attach) {};
+  virtual bool WantsInput();
+  virtual void SetVideoPid(int pid, int type);
+  virtual bool FindKeyframe(int64_t pts, off_t *pos);
+  virtual bool LastKeyframe(off_t *pos);
+  virtual bool WaitForData(int timeoutMs);
+  virtual void Wakeup();
+
+protected:
+  cVideoBufferShared(const cChannel *channel);
+  virtual ~cVideoBufferShared();
+  cTimeshiftStore *m_Store;
+  uint64_t m_Pos;
+  uint64_t m_StartPos;
+  time_t m_StartTime;
+  uint64_t m_HoldStart, m_HoldEnd;
+  unsigned int m_Margin;
+  unsigned int m_BytesConsumed;
+  uint8_t m_Bounce[TS_SIZE*2];
+  std::vector<uint8_t> m_PatPmt;
+  size_t m_PatPmtPtr;
+};
+
+cMutex cTimeshiftStore::m_StoresMutex;
+std::map<std::string, cTimeshiftStore*> cTimeshiftStore::m_Stores;
+
+cTimeshiftStore::cTimeshiftStore(const std::string &key)
+{
+  m_Key = key;
+  m_Tail = 0;
+  m_Head = 0;
+  m_EndTime = 0;
+  m_PutChunk = NULL;
+  m_Feeder = NULL;
+  m_Overflow = false;
+  m_MaxChunks = (off_t)TimeshiftBufferSize*100*1000*1000 / VIDEOBUFFER_CHUNK_SIZE;
+  if (m_MaxChunks < 2)
+    m_MaxChunks = 2;
+  cVideoBufferPool::Instance().Attach();
+  INFOLOG("shared timeshift buffer for channel %s with max size: %ld", m_Key.c_str(), (long)(m_MaxChunks * VIDEOBUFFER_CHUNK_SIZE));
 }
 
-cVideoBuffer::~cVideoBuffer()
+cTimeshiftStore::~cTimeshiftStore()
 {
+  cVideoBufferPool &pool = cVideoBufferPool::Instance();
+  for (std::deque<uint8_t*>::iterator it = m_Chunks.begin(); it != m_Chunks.end(); ++it)
+    pool.Free(*it);
+  for (std::list<std::pair<uint64_t, uint8_t*> >::iterator it = m_Cut.begin(); it != m_Cut.end(); ++it)
+    pool.Free(it->second);
+  pool.Detach();
+  INFOLOG("deleted shared timeshift buffer for channel %s", m_Key.c_str());
 }
 
-cVideoBuffer* cVideoBuffer::Create(int clientID, uint8_t timeshift)
+cTimeshiftStore *cTimeshiftStore::Attach(const cChannel *channel, cVideoBufferShared *reader)
 {
-  // no time shift
-  if (TimeshiftMode == 0 || timeshift == 0)
+  cMutexLock storesLock(&m_StoresMutex);
+
+  std::string key = *channel->GetChannelID().ToString();
+  cTimeshiftStore *store;
+  std::map<std::string, cTimeshiftStore*>::iterator it = m_Stores.find(key);
+  if (it != m_Stores.end())
+    store = it->second;
+  else
   {
-    cVideoBufferSimple *buffer = new cVideoBufferSimple();
+    store = new cTimeshiftStore(key);
+    m_Stores[key] = store;
+  }
+
+  cMutexLock lock(&store->m_Mutex);
+  store->m_Readers.push_back(reader);
+  if (!store->m_Feeder)
+    store->m_Feeder = reader;
+  reader->m_Pos = reader->m_StartPos = store->m_Head;
+  return store;
+}
+
+void cTimeshiftStore::Detach(cVideoBufferShared *reader)
+{
+  cMutexLock storesLock(&m_StoresMutex);
+
+  {
+    cMutexLock lock(&m_Mutex);
+    m_Readers.remove(reader);
+    if (m_Feeder == reader)
+    {
+      m_Feeder = m_Readers.empty() ? NULL : m_Readers.front();
+      if (m_Feeder)
+        INFOLOG("shared timeshift buffer for channel %s gets a new feeder", m_Key.c_str());
+    }
+    if (!m_Readers.empty())
+      return;
+  }
+
+  m_Stores.erase(m_Key);
+  delete this;
+}
+
+// caller holds m_Mutex
+bool cTimeshiftStore::IsHeld(uint64_t pos)
+{
+  for (std::list<cVideoBufferShared*>::iterator it = m_Readers.begin(); it != m_Readers.end(); ++it)
+  {
+    if ((*it)->m_HoldEnd > pos && (*it)->m_HoldStart < pos + VIDEOBUFFER_CHUNK_SIZE)
+      return true;
+  }
+  return false;
+}
+
+// caller holds m_Mutex
+uint8_t *cTimeshiftStore::Chunk(uint64_t pos)
+{
+  size_t index = (pos - m_Tail) / VIDEOBUFFER_CHUNK_SIZE;
+  if (pos < m_Tail || index >= m_Chunks.size())
+    return NULL;
+  return m_Chunks[index];
+}
+
+uint8_t *cTimeshiftStore::NewChunk(uint64_t head)
+{
+  cVideoBufferPool &pool = cVideoBufferPool::Instance();
+  cMutexLock lock(&m_Mutex);
+
+  // chunks cut off under a reader go back once it moved on
+  for (std::list<std::pair<uint64_t, uint8_t*> >::iterator it = m_Cut.begin(); it != m_Cut.end();)
+  {
+    if (IsHeld(it->first))
+      ++it;
+    else
+    {
+      pool.Free(it->second);
+      it = m_Cut.erase(it);
+    }
+  }
+
+  uint8_t *chunk = NULL;
+  size_t chunks = m_Chunks.size() + m_Cut.size();
+  if (chunks < 2)
+    chunk = pool.Alloc(true);
+  else if (chunks < m_MaxChunks && !pool.OverShare(chunks))
+    chunk = pool.Alloc();
+
+  // full or short of memory, reuse the oldest chunk. If a reader is still
+  // in there, the chunk is cut off and kept until the reader moved on.
+  // Chunks above the limit go back to the pool
+  while (!chunk && m_Chunks.size() >= 2)
+  {
+    uint64_t pos = m_Tail;
+    chunk = m_Chunks.front();
+    m_Chunks.pop_front();
+    m_ChunkTime.pop_front();
+    m_Tail += VIDEOBUFFER_CHUNK_SIZE;
+    if (IsHeld(pos))
+    {
+      m_Cut.push_back(std::make_pair(pos, chunk));
+      chunk = NULL;
+    }
+    else if (m_Chunks.size() + m_Cut.size() >= m_MaxChunks)
+    {
+      pool.Free(chunk);
+      chunk = NULL;
+    }
+  }
+  // all held, the data is dropped
+  if (!chunk)
+    return NULL;
+
+  if (m_Chunks.empty())
+    m_Tail = head;
+  m_Chunks.push_back(chunk);
+  m_ChunkTime.push_back(time(NULL));
+  m_PutChunk = chunk;
+  return chunk;
+}
+
+void cTimeshiftStore::Put(cVideoBufferShared *feeder, const uint8_t *buf, unsigned int size)
+{
+  if (m_Feeder != feeder)
+    return;
+
+  uint64_t head = m_Head.load(std::memory_order_relaxed);
+  m_Index.Put(buf, size, head, head, 0);
+  uint64_t start = head;
+
+  while (size)
+  {
+    unsigned int offset = head % VIDEOBUFFER_CHUNK_SIZE;
+    if (offset == 0 && !NewChunk(head))
+    {
+      feeder->m_OverflowCount++;
+      if (!m_Overflow)
+        ERRORLOG("Shared timeshift buffer for channel %s full, dropping data", m_Key.c_str());
+      m_Overflow = true;
+      break;
+    }
+    if (offset == 0)
+      m_Overflow = false;
+    unsigned int bytes = VIDEOBUFFER_CHUNK_SIZE - offset;
+    if (bytes > size)
+      bytes = size;
+    memcpy(m_PutChunk + offset, buf, bytes);
+    buf += bytes;
+    size -= bytes;
+    head += bytes;
+  }
+
+  m_EndTime = time(NULL);
+  m_Head.store(head, std::memory_order_release);
+  m_DataEvent.Notify(head - start);
+}
+
+cVideoBufferShared::cVideoBufferShared(const cChannel *channel)
+{
+  m_Margin = TS_SIZE*2;
+  m_BytesConsumed = 0;
+  m_HoldStart = m_HoldEnd = 0;
+  m_StartTime = time(NULL);
+
+  // the stream is joined in the middle, start with PAT/PMT for the demuxer
+  cPatPmtGenerator patPmtGenerator(channel);
+  m_PatPmt.insert(m_PatPmt.end(), patPmtGenerator.GetPat(), patPmtGenerator.GetPat() + TS_SIZE);
+  int Index = 0;
+  while (uchar *pmt = patPmtGenerator.GetPmt(Index))
+    m_PatPmt.insert(m_PatPmt.end(), pmt, pmt + TS_SIZE);
+  m_PatPmtPtr = 0;
+
+  m_Store = cTimeshiftStore::Attach(channel, this);
+}
+
+cVideoBufferShared::~cVideoBufferShared()
+{
+  m_Store->Detach(this);
+}
+
+bool cVideoBufferShared::WantsInput()
+{
+  return m_Store->m_Feeder == this;
+}
+
+void cVideoBufferShared::SetVideoPid(int pid, int type)
+{
+  m_Store->m_Index.SetVideoPid(pid, type);
+}
+
+bool cVideoBufferShared::FindKeyframe(int64_t pts, off_t *pos)
+{
+  return m_Store->m_Index.Find(pts, GetPosMin(), pos);
+}
+
+bool cVideoBufferShared::LastKeyframe(off_t *pos)
+{
+  return m_Store->m_Index.Last(GetPosMin(), pos);
+}
+
+// all readers wait on the store, the feeder wakes them up
+bool cVideoBufferShared::WaitForData(int timeoutMs)
+{
+  return m_Store->m_DataEvent.Wait(timeoutMs);
+}
+
+void cVideoBufferShared::Wakeup()
+{
+  m_Store->m_DataEvent.Wakeup();
+}
+
+void cVideoBufferShared::Put(const uint8_t *buf, unsigned int size)
+{
+  m_Store->Put(this, buf, size);
+}
+
+time_t cVideoBufferShared::GetRefTime()
+{
+  return m_StartTime;
+}
+
+off_t cVideoBufferShared::GetPosMin()
+{
+  cMutexLock lock(&m_Store->m_Mutex);
+  return m_Store->m_Tail > m_StartPos ? m_Store->m_Tail : m_StartPos;
+}
+
+off_t cVideoBufferShared::GetPosMax()
+{
+  return m_Store->m_Head.load(std::memory_order_acquire);
+}
+
+off_t cVideoBufferShared::GetPosCur()
+{
+  return m_Pos;
+}
+
+void cVideoBufferShared::GetPositions(off_t *cur, off_t *min, off_t *max)
+{
+  *cur = GetPosCur();
+  *min = GetPosMin();
+  *min = (*min > *cur) ? *cur : *min;
+  *max = GetPosMax();
+}
+
+void cVideoBufferShared::SetPos(off_t pos)
+{
+  off_t min = GetPosMin();
+  off_t max = GetPosMax();
+  if (pos < min)
+    pos = min;
+  else if (pos > max)
+    pos = max;
+  m_Pos = pos;
+  m_BytesConsumed = 0;
+}
+
+int cVideoBufferShared::ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime)
+{
+  if (m_PatPmtPtr < m_PatPmt.size())
+  {
+    *buf = &m_PatPmt[m_PatPmtPtr];
+    m_PatPmtPtr += TS_SIZE;
+    return TS_SIZE;
+  }
+
+  off_t readBytes;
+  {
+    cMutexLock lock(&m_Store->m_Mutex);
+
+    // move read pointer
+    if (m_BytesConsumed)
+    {
+      m_Pos += m_BytesConsumed;
+
+      // the part of the store before this reader joined is not offered
+      endTime = m_Store->m_EndTime;
+      if (m_Store->m_Tail > m_StartPos && !m_Store->m_ChunkTime.empty())
+        wrapTime = m_StartTime + (endTime - m_Store->m_ChunkTime.front());
+      else
+        wrapTime = 0;
+    }
+    m_BytesConsumed = 0;
+    m_HoldStart = m_HoldEnd = 0;
+
+    if (m_Pos < m_Store->m_Tail)
+    {
+      INFOLOG("shared timeshift buffer overrun, skipping %ld bytes", (long)(m_Store->m_Tail - m_Pos));
+      m_Pos = m_Store->m_Tail;
+    }
+
+    // check if we have anything to read
+    readBytes = m_Store->m_Head.load(std::memory_order_acquire) - m_Pos;
+    if (readBytes < m_Margin)
+    {
+      return 0;
+    }
+
+    // if we are close to the end of a chunk, copy margin to bounce buffer
+    unsigned int chunkOffset = m_Pos % VIDEOBUFFER_CHUNK_SIZE;
+    uint8_t *chunk = m_Store->Chunk(m_Pos);
+    if (chunkOffset > VIDEOBUFFER_CHUNK_SIZE - m_Margin)
+    {
+      int bytesToCopy = VIDEOBUFFER_CHUNK_SIZE - chunkOffset;
+      memcpy(m_Bounce, chunk + chunkOffset, bytesToCopy);
+      memcpy(m_Bounce + bytesToCopy, m_Store->Chunk(m_Pos + bytesToCopy), m_Margin - bytesToCopy);
+      *buf = m_Bounce;
+      readBytes = m_Margin;
+    }
+    else
+    {
+      *buf = chunk + chunkOffset;
+      if (readBytes > VIDEOBUFFER_CHUNK_SIZE - chunkOffset)
+        readBytes = VIDEOBUFFER_CHUNK_SIZE - chunkOffset;
+      m_HoldStart = m_Pos;
+      m_HoldEnd = m_Pos + readBytes;
+    }
+  }
+
+  // Make sure we are looking at a TS packet
+  int offset = Resync(*buf, readBytes);
+  m_BytesConsumed += offset;
+  (*buf) += offset;
+  readBytes -= offset;
+
+  if ((*buf)[0] != TS_SYNC_BYTE)
+  {
+    return 0;
+  }
+
+  int len = PacketSpan(*buf, readBytes, size);
+  m_BytesConsumed += len;
+  return len;
+}
+
+//-----------------------------------------------------------------------------
+
+// Starts on a live ring and only gets a timeshift buffer once the client
+// pauses or the ring fills up because the client falls behind. The producer
+// switches to the new buffer between two Puts, the reader drains the ring
+// first and continues at the start of the timeshift buffer, so no data is
+// lost or reordered. A congested ring only raises a flag on the receiver
+// thread, the timeshift buffer is created by the reader.
+class cVideoBufferLive : public cVideoBuffer
+{
+friend class cVideoBuffer;
+public:
+  virtual ~cVideoBufferLive();
+  virtual void Put(const uint8_t *buf, unsigned int size);
+  virtual int ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime);
+  virtual off_t GetPosMin() { return Reading()->GetPosMin(); };
+  virtual off_t GetPosMax() { return Reading()->GetPosMax(); };
+  virtual off_t GetPosCur() { return Reading()->GetPosCur(); };
+  virtual void GetPositions(off_t *cur, off_t *min, off_t *max) { Reading()->GetPositions(cur, min, max); };
+  virtual void SetPos(off_t pos) { Reading()->SetPos(pos); };
+  virtual void SetCache(bool on) { Reading()->SetCache(on); };
+  virtual bool HasBuffer() { return m_ReadTimeshift; };
+  virtual time_t GetRefTime() { return Reading()->GetRefTime(); };
+  virtual void SetVideoPid(int pid, int type);
+  virtual bool FindKeyframe(int64_t pts, off_t *pos) { return Reading()->FindKeyframe(pts, pos); };
+  virtual bool LastKeyframe(off_t *pos) { return Reading()->LastKeyframe(pos); };
+  virtual bool Export(time_t start, time_t end, const cChannel *channel, const char *name);
+  virtual bool Promote();
+  virtual bool WaitForData(int timeoutMs);
+  virtual void Wakeup();
+  virtual uint32_t GetResyncCount();
+  virtual uint32_t GetOverflowCount();
+
+protected:
+  cVideoBufferLive(int clientID);
+  cVideoBuffer *Reading() { return m_ReadTimeshift ? m_Timeshift.load(std::memory_order_acquire) : m_Ring; };
+  int m_ClientID;
+  cVideoBufferSimple *m_Ring;
+  std::atomic<cVideoBuffer*> m_Timeshift;
+  std::atomic<cVideoBuffer*> m_Pending;
+  std::atomic<bool> m_ReadTimeshift;
+  std::atomic<bool> m_PromoteWanted;
+  int m_VideoPid;
+  int m_VideoType;
+  cMutex m_Mutex;
+};
+
+cVideoBufferLive::cVideoBufferLive(int clientID)
+{
+  m_ClientID = clientID;
+  m_Ring = new cVideoBufferSimple();
+  m_Timeshift = NULL;
+  m_Pending = NULL;
+  m_ReadTimeshift = false;
+  m_PromoteWanted = false;
+  m_VideoPid = 0;
+  m_VideoType = 0;
+}
+
+cVideoBufferLive::~cVideoBufferLive()
+{
+  if (m_Timeshift)
+    delete m_Timeshift;
+  else if (m_Pending)
+    delete m_Pending;
+  delete m_Ring;
+}
+
+// called by any thread but the receiver, creating the file takes a while,
+// the producer picks the buffer up with its next Put
+bool cVideoBufferLive::Promote()
+{
+  cMutexLock lock(&m_Mutex);
+
+  if (m_Pending.load(std::memory_order_acquire))
+    return true;
+
+  cVideoBuffer *buffer = CreateTimeshift(m_ClientID);
+  if (!buffer)
+  {
+    ERRORLOG("Could not start timeshift buffer");
+    return false;
+  }
+  buffer->SetVideoPid(m_VideoPid, m_VideoType);
+  m_Pending.store(buffer, std::memory_order_release);
+  return true;
+}
+
+void cVideoBufferLive::Put(const uint8_t *buf, unsigned int size)
+{
+  cVideoBuffer *timeshift = m_Timeshift.load(std::memory_order_relaxed);
+  if (!timeshift)
+  {
+    cVideoBuffer *pending = m_Pending.load(std::memory_order_acquire);
+    if (!pending && m_Ring->Congested() && !m_PromoteWanted.exchange(true))
+      m_Ring->Wakeup();
+    if (pending)
+    {
+      INFOLOG("Live buffer promoted to timeshift buffer");
+      m_Timeshift.store(pending, std::memory_order_release);
+      m_Ring->Wakeup();
+      timeshift = pending;
+    }
+  }
+
+  if (timeshift)
+    timeshift->Put(buf, size);
+  else
+    m_Ring->Put(buf, size);
+}
+
+int cVideoBufferLive::ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime)
+{
+  if (!m_ReadTimeshift)
+  {
+    if (m_PromoteWanted.exchange(false))
+      Promote();
+
+    // look at the switch first, the ring is complete once it was made
+    cVideoBuffer *timeshift = m_Timeshift.load(std::memory_order_acquire);
+    int len = m_Ring->ReadBlock(buf, size, endTime, wrapTime);
+    if (len > 0 || !timeshift)
+      return len;
+    m_ReadTimeshift = true;
+  }
+  return m_Timeshift.load(std::memory_order_relaxed)->ReadBlock(buf, size, endTime, wrapTime);
+}
+
+void cVideoBufferLive::SetVideoPid(int pid, int type)
+{
+  cMutexLock lock(&m_Mutex);
+
+  m_VideoPid = pid;
+  m_VideoType = type;
+  cVideoBuffer *buffer = m_Pending.load(std::memory_order_acquire);
+  if (buffer)
+    buffer->SetVideoPid(pid, type);
+}
+
+bool cVideoBufferLive::Export(time_t start, time_t end, const cChannel *channel, const char *name)
+{
+  cVideoBuffer *timeshift = m_Timeshift.load(std::memory_order_acquire);
+  return timeshift && timeshift->Export(start, end, channel, name);
+}
+
+// new data arrives where the producer puts it
+bool cVideoBufferLive::WaitForData(int timeoutMs)
+{
+  cVideoBuffer *timeshift = m_Timeshift.load(std::memory_order_acquire);
+  return timeshift ? timeshift->WaitForData(timeoutMs) : m_Ring->WaitForData(timeoutMs);
+}
+
+void cVideoBufferLive::Wakeup()
+{
+  m_Ring->Wakeup();
+  cVideoBuffer *timeshift = m_Timeshift.load(std::memory_order_acquire);
+  if (timeshift)
+    timeshift->Wakeup();
+}
+
+uint32_t cVideoBufferLive::GetResyncCount()
+{
+  cVideoBuffer *timeshift = m_Timeshift.load(std::memory_order_acquire);
+  return m_Ring->GetResyncCount() + (timeshift ? timeshift->GetResyncCount() : 0);
+}
+
+uint32_t cVideoBufferLive::GetOverflowCount()
+{
+  cVideoBuffer *timeshift = m_Timeshift.load(std::memory_order_acquire);
+  return m_Ring->GetOverflowCount() + (timeshift ? timeshift->GetOverflowCount() : 0);
+}
+
+//-----------------------------------------------------------------------------
+
+cVideoBuffer::cVideoBuffer()
+{
+  m_ResyncCount = 0;
+  m_OverflowCount = 0;
+  m_CheckEof = false;
+  m_InputAttached = true;
+  m_bufferEndTime = 0;
+  m_bufferWrapTime = 0;
+}
+
+cVideoBuffer::~cVideoBuffer()
+{
+}
+
+cVideoBuffer* cVideoBuffer::Create(int clientID, uint8_t timeshift, const cChannel *channel)
+{
+  // no time shift, or time shift after the demuxer
+  if (TimeshiftMode == 0 || TimeshiftMode == 4 || timeshift == 0)
+  {
+    cVideoBufferSimple *buffer = new cVideoBufferSimple();
+    return buffer;
+  }
+  // buffer in ram, shared with other clients on this channel
+  else if (TimeshiftMode == 1 && TimeshiftShared && channel)
+  {
+    cVideoBufferShared *buffer = new cVideoBufferShared(channel);
     return buffer;
   }
+  // time shift once the client needs it
+  else if (TimeshiftOnDemand)
+  {
+    cVideoBufferLive *buffer = new cVideoBufferLive(clientID);
+    return buffer;
+  }
+  else
+    return CreateTimeshift(clientID);
+}
+
+cVideoBuffer* cVideoBuffer::CreateTimeshift(int clientID)
+{
   // buffer in ram
-  else if (TimeshiftMode == 1)
+  if (TimeshiftMode == 1)
   {
     cVideoBufferRAM *buffer = new cVideoBufferRAM();
     if (!buffer->Init())
@@ -890,6 +2654,18 @@ cVideoBuffer* cVideoBuffer::Create(int clientID, uint8_t timeshift)
     else
       return buffer;
   }
+  // buffer in file, recent part kept in ram
+  else if (TimeshiftMode == 3)
+  {
+    cVideoBufferFile *buffer = new cVideoBufferFile(clientID, TimeshiftRAMSeconds);
+    if (!buffer->Init())
+    {
+      delete buffer;
+      return NULL;
+    }
+    else
+      return buffer;
+  }
   else
     return NULL;
 }
@@ -907,10 +2683,10 @@ cVideoBuffer* cVideoBuffer::Create(cString filename)
     return buffer;
 }
 
-cVideoBuffer* cVideoBuffer::Create(const cRecording *rec)
+cVideoBuffer* cVideoBuffer::Create(const cRecording *rec, bool live)
 {
   INFOLOG("Open recording: %s", rec->FileName());
-  cVideoBufferRecording *buffer = new cVideoBufferRecording(rec);
+  cVideoBufferRecording *buffer = new cVideoBufferRecording(rec, live);
   if (!buffer->Init())
   {
     delete buffer;
@@ -925,7 +2701,7 @@ int cVideoBuffer::Read(uint8_t **buf, unsigned int size, time_t &endTime, time_t
   int count = ReadBlock(buf, size, endTime, wrapTime);
 
   // check for end of file
-  if (!m_InputAttached && count != TS_SIZE)
+  if (!m_InputAttached && count <= 0)
   {
     if (m_CheckEof && m_Timer.TimedOut())
     {
@@ -944,11 +2720,89 @@ int cVideoBuffer::Read(uint8_t **buf, unsigned int size, time_t &endTime, time_t
   return count;
 }
 
+int cVideoBuffer::Resync(const uint8_t *buf, off_t readBytes)
+{
+  // don't scan more than a few packets per call
+  if (readBytes > TS_SIZE*64)
+    readBytes = TS_SIZE*64;
+
+  int offset = TsSyncOffset(buf, readBytes);
+  if (offset)
+    m_ResyncCount++;
+  return offset;
+}
+
 void cVideoBuffer::AttachInput(bool attach)
 {
   m_InputAttached = attach;
 }
 
+// buffers without a writer, like recordings, only time out
+bool cVideoBuffer::WaitForData(int timeoutMs)
+{
+  return m_DataEvent.Wait(timeoutMs);
+}
+
+void cVideoBuffer::Wakeup()
+{
+  m_DataEvent.Wakeup();
+}
+
+//-----------------------------------------------------------------------------
+
+// enough to fill a read span of the demuxer
+#define VIDEOBUFFER_WAKEUP_SIZE (TS_SIZE * 64)
+// low bitrate streams take long for that, they wake on the first write
+// after this, as they did when the reader polled
+#define VIDEOBUFFER_WAKEUP_TIME 10
+
+cVideoBufferEvent::cVideoBufferEvent()
+{
+  m_Waiters = 0;
+  m_Pending = 0;
+  m_WaitStart = 0;
+  m_Signaled = false;
+}
+
+void cVideoBufferEvent::Notify(unsigned int size)
+{
+  if (!m_Waiters.load(std::memory_order_acquire))
+    return;
+  if (m_Pending.fetch_add(size, std::memory_order_relaxed) + size < VIDEOBUFFER_WAKEUP_SIZE &&
+      cTimeMs::Now() - m_WaitStart.load(std::memory_order_relaxed) < VIDEOBUFFER_WAKEUP_TIME)
+    return;
+  Wakeup();
+}
+
+bool cVideoBufferEvent::Wait(int timeoutMs)
+{
+  cMutexLock lock(&m_Mutex);
+
+  if (!m_Signaled)
+  {
+    if (!m_Waiters.load(std::memory_order_relaxed))
+    {
+      m_Pending.store(0, std::memory_order_relaxed);
+      m_WaitStart.store(cTimeMs::Now(), std::memory_order_relaxed);
+    }
+    m_Waiters.fetch_add(1, std::memory_order_release);
+    m_Cond.TimedWait(m_Mutex, timeoutMs);
+    m_Waiters.fetch_sub(1, std::memory_order_relaxed);
+  }
+  bool ret = m_Signaled;
+  m_Signaled = false;
+  return ret;
+}
+
+void cVideoBufferEvent::Wakeup()
+{
+  cMutexLock lock(&m_Mutex);
+
+  m_Pending.store(0, std::memory_order_relaxed);
+  m_Signaled = true;
+  m_Cond.Broadcast();
+}
+
 time_t cVideoBuffer::GetRefTime()
 {
   time_t t;
@@ -26,17 +26,72 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <atomic>
+#include <vector>
 #include <vdr/tools.h>
+#include <vdr/thread.h>
 
 class cRecording;
+class cChannel;
+
+/*!
+ * Wakes a reader that waits for data. Writers only take the lock when a
+ * reader waits and enough data came in since, so one wakeup covers many
+ * packets.
+ */
+class cVideoBufferEvent
+{
+public:
+  cVideoBufferEvent();
+  void Notify(unsigned int size);
+  bool Wait(int timeoutMs);
+  void Wakeup();
+
+protected:
+  cMutex m_Mutex;
+  cCondVar m_Cond;
+  std::atomic<int> m_Waiters;
+  std::atomic<unsigned int> m_Pending;
+  std::atomic<uint64_t> m_WaitStart;
+  bool m_Signaled;
+};
+
+/*!
+ * Chunks for the timeshift buffers, shared by all clients. The kernel only
+ * commits the memory of a chunk when it is first written to. With a budget
+ * set, RAM buffers grow while there is room and give chunks back to the
+ * pool when other buffers run short. Buffers with chunks of their own
+ * reserve the memory here, so that it counts against the same budget.
+ */
+class cVideoBufferPool
+{
+public:
+  static cVideoBufferPool &Instance();
+  uint8_t *Alloc(bool force = false);
+  void Free(uint8_t *chunk);
+  bool Reserve(size_t size, bool force = false);
+  void Release(size_t size);
+  void Attach();
+  void Detach();
+  bool OverShare(size_t chunks);
+  bool Exhausted();
+
+protected:
+  cVideoBufferPool();
+  int64_t Budget();
+  cMutex m_Mutex;
+  std::vector<uint8_t*> m_Cache;
+  int64_t m_Used;
+  int m_Users;
+};
 
 class cVideoBuffer
 {
 public:
   virtual ~cVideoBuffer();
-  static cVideoBuffer* Create(int clientID, uint8_t timeshift);
+  static cVideoBuffer* Create(int clientID, uint8_t timeshift, const cChannel *channel);
   static cVideoBuffer* Create(cString filename);
-  static cVideoBuffer* Create(const cRecording *rec);
+  static cVideoBuffer* Create(const cRecording *rec, bool live = false);
   virtual void Put(const uint8_t *buf, unsigned int size) = 0;
   virtual int ReadBlock(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime) = 0;
   virtual off_t GetPosMin() { return 0; };
@@ -47,13 +102,31 @@ public:
   virtual void SetCache(bool on) {};
   virtual bool HasBuffer() { return false; };
   virtual time_t GetRefTime();
+  virtual bool WantsInput() { return true; };
+  virtual void SetVideoPid(int pid, int type) {};
+  virtual bool FindKeyframe(int64_t pts, off_t *pos) { return false; };
+  virtual bool LastKeyframe(off_t *pos) { return false; };
+  virtual bool Export(time_t start, time_t end, const cChannel *channel, const char *name) { return false; };
+  virtual bool ReadAt(uint64_t pos, uint8_t *buf, unsigned int size) { return false; };
+  virtual int GetFile(uint64_t pos, unsigned int size, off_t *offset) { return -1; };
+  virtual bool IsReadable(uint64_t pos) { return false; };
+  virtual bool Promote() { return HasBuffer(); };
   int Read(uint8_t **buf, unsigned int size, time_t &endTime, time_t &wrapTime);
-  void AttachInput(bool attach);
+  virtual void AttachInput(bool attach);
+  virtual bool WaitForData(int timeoutMs);
+  virtual void Wakeup();
+  virtual uint32_t GetResyncCount() { return m_ResyncCount; }
+  virtual uint32_t GetOverflowCount() { return m_OverflowCount; }
 protected:
   cVideoBuffer();
+  static cVideoBuffer* CreateTimeshift(int clientID);
+  int Resync(const uint8_t *buf, off_t readBytes);
+  uint32_t m_ResyncCount;
+  uint32_t m_OverflowCount;
   cTimeMs m_Timer;
   bool m_CheckEof;
   bool m_InputAttached;
-  time_t m_bufferEndTime;
-  time_t m_bufferWrapTime;
+  std::atomic<time_t> m_bufferEndTime;
+  std::atomic<time_t> m_bufferWrapTime;
+  cVideoBufferEvent m_DataEvent;
 };
@@ -36,6 +36,8 @@
 #include <libsi/section.h>
 #include <libsi/descriptor.h>
 
+#include <algorithm>
+
 // --- cLiveReceiver -------------------------------------------------
 
 class cLiveReceiver: public cReceiver
@@ -425,6 +427,9 @@ cVideoInput::cVideoInput(cCondVar &condVar, cMutex &mutex, bool &retune) :
   m_VideoBuffer = NULL;
   m_Priority = 0;
   m_PmtChange = false;
+  m_StagingLen = 0;
+  m_StagingTime = 0;
+  m_FlushRequest = false;
 }
 
 cVideoInput::~cVideoInput()
@@ -437,6 +442,8 @@ bool cVideoInput::Open(const cChannel *channel, int priority, cVideoBuffer *vide
   m_VideoBuffer = videoBuffer;
   m_Channel = channel;
   m_Priority = priority;
+  m_StagingLen = 0;
+  m_FlushRequest = false;
   m_Device = cDevice::GetDevice(m_Channel, m_Priority, false);
 
   if (m_Device != NULL)
@@ -472,6 +479,7 @@ bool cVideoInput::Open(const cChannel *channel, int priority, cVideoBuffer *vide
       }
 #endif
 
+      m_VideoBuffer->SetVideoPid(m_PmtChannel.Vpid(), m_PmtChannel.Vtype());
       m_VideoBuffer->AttachInput(true);
       return true;
     }
@@ -531,6 +539,8 @@ void cVideoInput::Close()
   m_Device = NULL;
   if (m_VideoBuffer)
   {
+    // the receiver is gone, commit what it left
+    Flush();
     m_VideoBuffer->AttachInput(false);
     m_VideoBuffer = NULL;
   }
@@ -549,10 +559,19 @@ cChannel *cVideoInput::PmtChannel()
   return &m_PmtChannel;
 }
 
+static inline uint64_t CoarseTimeMs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 inline void cVideoInput::Receive(const uchar *data, int length)
 {
   if (m_PmtChange)
   {
+     Flush();
+
      // generate pat/pmt so we can configure parsers later
      cPatPmtGenerator patPmtGenerator(&m_PmtChannel);
      m_VideoBuffer->Put(patPmtGenerator.GetPat(), TS_SIZE);
@@ -561,7 +580,55 @@ inline void cVideoInput::Receive(const uchar *data, int length)
        m_VideoBuffer->Put(pmt, TS_SIZE);
      m_PmtChange = false;
   }
-  m_VideoBuffer->Put(data, length);
+
+  // the receiver delivers single packets, stage them and put a block at a
+  // time, or once the streamer found the oldest packet waited long enough
+  int len = m_StagingLen.load(std::memory_order_relaxed);
+  if (len + length > VIDEOINPUT_BATCH_SIZE)
+  {
+    Flush();
+    len = 0;
+  }
+  if (length >= VIDEOINPUT_BATCH_SIZE)
+  {
+    m_VideoBuffer->Put(data, length);
+    return;
+  }
+
+  if (!len)
+    m_StagingTime.store(CoarseTimeMs(), std::memory_order_relaxed);
+  memcpy(m_Staging + len, data, length);
+  len += length;
+  m_StagingLen.store(len, std::memory_order_release);
+
+  if (len + TS_SIZE > VIDEOINPUT_BATCH_SIZE || m_FlushRequest.load(std::memory_order_relaxed))
+    Flush();
+}
+
+// called by the streamer when it ran out of data. Staged data older than
+// VIDEOINPUT_BATCH_TIME is committed by the receiver with its next packet.
+// Returns how long the streamer may wait, at most maxWait ms.
+int cVideoInput::FlushStale(int maxWait)
+{
+  if (!m_StagingLen.load(std::memory_order_acquire))
+    return maxWait;
+  int age = CoarseTimeMs() - m_StagingTime.load(std::memory_order_relaxed);
+  if (age < VIDEOINPUT_BATCH_TIME)
+    return std::min(VIDEOINPUT_BATCH_TIME - age, maxWait);
+  m_FlushRequest.store(true, std::memory_order_relaxed);
+  return maxWait;
+}
+
+// called by the receiver, or once it is gone
+void cVideoInput::Flush()
+{
+  int len = m_StagingLen.load(std::memory_order_relaxed);
+  if (len)
+  {
+    m_VideoBuffer->Put(m_Staging, len);
+    m_StagingLen.store(0, std::memory_order_relaxed);
+  }
+  m_FlushRequest.store(false, std::memory_order_relaxed);
 }
 
 void cVideoInput::Retune()
@@ -569,4 +636,6 @@ void cVideoInput::Retune()
   cMutexLock lock(&m_Mutex);
   m_IsRetune = true;
   m_Event.Broadcast();
+  if (m_VideoBuffer)
+    m_VideoBuffer->Wakeup();
 }
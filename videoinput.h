@@ -26,12 +26,17 @@
 
 #include <vdr/channels.h>
 #include <vdr/thread.h>
+#include <atomic>
 
 class cLivePatFilter;
 class cLiveReceiver;
 class cVideoBuffer;
 class cDevice;
 
+// received TS packets are committed to the video buffer in blocks
+#define VIDEOINPUT_BATCH_SIZE (188 * 256)
+#define VIDEOINPUT_BATCH_TIME 10
+
 class cVideoInput
 {
 friend class cLivePatFilter;
@@ -42,10 +47,12 @@ public:
   bool Open(const cChannel *channel, int priority, cVideoBuffer *videoBuffer);
   void Close();
   bool IsOpen();
+  int FlushStale(int maxWait);
 
 protected:
   cChannel *PmtChannel();
   void Receive(const uchar *data, int length);
+  void Flush();
   void Retune();
   cDevice          *m_Device;
   cLivePatFilter   *m_PatFilter;
@@ -58,4 +65,8 @@ protected:
   cMutex            &m_Mutex;
   bool              &m_IsRetune;
   cChannel m_PmtChannel;
+  uint8_t           m_Staging[VIDEOINPUT_BATCH_SIZE];   /*!> Owned by the receiver, only it commits */
+  std::atomic<int>  m_StagingLen;
+  std::atomic<uint64_t> m_StagingTime;                  /*!> When the first staged packet came in */
+  std::atomic<bool> m_FlushRequest;                     /*!> Set by the streamer for stale data */
 };
@@ -26,6 +26,8 @@
 #include "vnsi.h"
 #include "vnsicommand.h"
 #include "setup.h"
+#include "streamer.h"
+#include "iopriority.h"
 
 #include <getopt.h>
 #include <vdr/plugin.h>
@@ -111,6 +113,7 @@ void cPluginVNSIServer::Stop(void)
 void cPluginVNSIServer::Housekeeping(void)
 {
   // Perform any cleanup or other regular tasks.
+  cLiveStreamer::ExpireSessions();
 }
 
 void cPluginVNSIServer::MainThreadHook(void)
@@ -146,16 +149,44 @@ bool cPluginVNSIServer::SetupParse(const char *Name, const char *Value)
     TimeshiftMode = atoi(Value);
   else if (!strcasecmp(Name, CONFNAME_TIMESHIFTBUFFERSIZE))
     TimeshiftBufferSize = atoi(Value);
+  else if (!strcasecmp(Name, CONFNAME_TIMESHIFTMEMORYBUDGET))
+    TimeshiftMemoryBudget = atoi(Value);
+  else if (!strcasecmp(Name, CONFNAME_TIMESHIFTSHARED))
+    TimeshiftShared = atoi(Value);
   else if (!strcasecmp(Name, CONFNAME_TIMESHIFTBUFFERFILESIZE))
     TimeshiftBufferFileSize = atoi(Value);
   else if (!strcasecmp(Name, CONFNAME_TIMESHIFTBUFFERDIR))
     strn0cpy(TimeshiftBufferDir, Value, sizeof(TimeshiftBufferDir));
+  else if (!strcasecmp(Name, CONFNAME_TIMESHIFTBUFFERDIRECTIO))
+    TimeshiftBufferDirectIO = atoi(Value);
+  else if (!strcasecmp(Name, CONFNAME_TIMESHIFTRAMSECONDS))
+    TimeshiftRAMSeconds = atoi(Value);
   else if (!strcasecmp(Name, CONFNAME_PLAYRECORDING))
     PlayRecording = atoi(Value);
   else if (!strcasecmp(Name, CONFNAME_AVOIDEPGSCAN))
     AvoidEPGScan = atoi(Value);
   else if (!strcasecmp(Name, CONFNAME_DISABLESCRAMBLETIMEOUT))
     DisableScrambleTimeout = atoi(Value);
+  else if (!strcasecmp(Name, CONFNAME_BACKZAPCHANNELS))
+    BackZapChannels = atoi(Value);
+  else if (!strcasecmp(Name, CONFNAME_BACKZAPGRACETIME))
+    BackZapGraceTime = atoi(Value);
+  else if (!strcasecmp(Name, CONFNAME_PACINGLEAD))
+    PacingLead = atoi(Value);
+  else if (!strcasecmp(Name, CONFNAME_LIVEBUFFERSECONDS))
+    LiveBufferSeconds = atoi(Value);
+  else if (!strcasecmp(Name, CONFNAME_TIMESHIFTONDEMAND))
+    TimeshiftOnDemand = atoi(Value);
+  else if (!strcasecmp(Name, CONFNAME_RESUMEGRACETIME))
+    ResumeGraceTime = atoi(Value);
+  else if (!strcasecmp(Name, CONFNAME_PESBUFFERMAXSIZE))
+  {
+    PesBufferMaxSize = atoi(Value);
+    if (PesBufferMaxSize > 64)
+      PesBufferMaxSize = 64;
+    else if (PesBufferMaxSize < 1)
+      PesBufferMaxSize = 1;
+  }
   else
     return false;
   return true;
@@ -170,12 +201,19 @@ bool cPluginVNSIServer::Service(const char *Id, void *Data)
 const char **cPluginVNSIServer::SVDRPHelpPages(void)
 {
   // Return help text for SVDRP commands this plugin implements
-  return NULL;
+  static const char *HelpPages[] = {
+    "IOST\n"
+    "    Print disk I/O counters of the plugin per priority class.",
+    NULL
+    };
+  return HelpPages;
 }
 
 cString cPluginVNSIServer::SVDRPCommand(const char *Command, const char *Option, int &ReplyCode)
 {
   // Process SVDRP commands this plugin implements
+  if (!strcasecmp(Command, "IOST"))
+    return cIOPriority::Report();
   return NULL;
 }
 
@@ -35,10 +35,21 @@ extern int PmtTimeout;
 extern int TimeshiftMode;
 extern int TimeshiftBufferSize;
 extern int TimeshiftBufferFileSize;
+extern int TimeshiftMemoryBudget;
+extern int TimeshiftShared;
 extern char TimeshiftBufferDir[PATH_MAX];
+extern int TimeshiftBufferDirectIO;
+extern int TimeshiftRAMSeconds;
 extern int PlayRecording;
 extern int AvoidEPGScan;
 extern int DisableScrambleTimeout;
+extern int BackZapChannels;
+extern int BackZapGraceTime;
+extern int PacingLead;
+extern int LiveBufferSeconds;
+extern int TimeshiftOnDemand;
+extern int ResumeGraceTime;
+extern int PesBufferMaxSize;
 
 class cDvbVsniDeviceProbe : public cDvbDeviceProbe
 {
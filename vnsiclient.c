@@ -37,11 +37,13 @@
 #include "hash.h"
 #include "channelfilter.h"
 #include "channelscancontrol.h"
+#include "iopriority.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <map>
 #include <memory>
+#include <random>
 
 #include <vdr/recording.h>
 #include <vdr/channels.h>
@@ -92,6 +94,9 @@ void cVNSIClient::Action(void)
   uint32_t dataLength;
   uint8_t* data;
 
+  // recordings are read on this thread
+  cIOPriority::Set(IOCLASS_PLAYBACK);
+
   while (Running())
   {
     if (!m_socket.read((uint8_t*)&channelID, sizeof(uint32_t))) break;
@@ -159,8 +164,9 @@ void cVNSIClient::Action(void)
   }
 
   /* If thread is ended due to closed connection delete a
-     possible running stream here */
-  StopChannelStreaming();
+     possible running stream here, or keep it for the client
+     to reconnect or for back-zap */
+  StopChannelStreaming(true, true);
   m_ChannelScanControl.StopScan();
 
   // Shutdown OSD
@@ -171,18 +177,53 @@ void cVNSIClient::Action(void)
 bool cVNSIClient::StartChannelStreaming(cResponsePacket &resp, const cChannel *channel, int32_t priority, uint8_t timeshift, uint32_t timeout)
 {
   delete m_Streamer;
+
+  // back-zap to a channel that was kept running
+  m_Streamer = cLiveStreamer::Resume(channel, priority, timeshift, &m_socket, &resp, NewToken());
+  if (m_Streamer)
+  {
+    m_isStreaming = true;
+    return true;
+  }
+
+  uint32_t token = NewToken();
   m_Streamer    = new cLiveStreamer(m_Id, m_bSupportRDS, timeshift, timeout);
-  m_isStreaming = m_Streamer->StreamChannel(channel, priority, &m_socket, &resp);
+  m_isStreaming = m_Streamer->StreamChannel(channel, priority, &m_socket, &resp, token);
+
+  // no device left, give up channels kept for back-zap
+  while (!m_isStreaming && cLiveStreamer::EvictParked())
+    m_isStreaming = m_Streamer->StreamChannel(channel, priority, &m_socket, &resp, token);
+
   return m_isStreaming;
 }
 
-void cVNSIClient::StopChannelStreaming()
+void cVNSIClient::StopChannelStreaming(bool park, bool session)
 {
   m_isStreaming = false;
-  delete m_Streamer;
+  if (park && session && m_Streamer)
+    cLiveStreamer::ParkSession(m_Streamer);
+  else if (park && m_Streamer)
+    cLiveStreamer::Park(m_Streamer);
+  else
+    delete m_Streamer;
   m_Streamer = NULL;
 }
 
+uint32_t cVNSIClient::NewToken()
+{
+  if (m_protocolVersion < VNSI_RESUME_PROTOCOLVERSION)
+    return 0;
+
+  static std::random_device rd;
+  static cMutex mutex;
+  cMutexLock lock(&mutex);
+  uint32_t token;
+  do
+    token = rd();
+  while (!token);
+  return token;
+}
+
 void cVNSIClient::SignalTimerChange()
 {
   cMutexLock lock(&m_msgLock);
@@ -371,6 +412,7 @@ void cVNSIClient::ChannelChange(const cChannel *Channel)
   {
     m_Streamer->RetuneChannel(Channel);
   }
+  cLiveStreamer::RetuneParked(Channel);
 }
 #endif
 
@@ -419,6 +461,18 @@ bool cVNSIClient::processRequest(cRequestPacket &req)
       result = processChannelStream_Seek(req);
       break;
 
+    case VNSI_CHANNELSTREAM_EXPORT:
+      result = processChannelStream_Export(req);
+      break;
+
+    case VNSI_CHANNELSTREAM_PAUSE:
+      result = processChannelStream_Pause(req);
+      break;
+
+    case VNSI_CHANNELSTREAM_RESUME:
+      result = processChannelStream_Resume(req);
+      break;
+
     /** OPCODE 40 - 59: VNSI network functions for recording streaming */
     case VNSI_RECSTREAM_OPEN:
       result = processRecStream_Open(req);
@@ -775,7 +829,7 @@ bool cVNSIClient::processChannelStream_Open(cRequestPacket &req) /* OPCODE 20 */
     : req.extract_U32();
 
   if (m_isStreaming)
-    StopChannelStreaming();
+    StopChannelStreaming(true);
 
   const cChannel *channel = FindChannelByUID(uid);
 
@@ -820,7 +874,7 @@ bool cVNSIClient::processChannelStream_Open(cRequestPacket &req) /* OPCODE 20 */
 bool cVNSIClient::processChannelStream_Close(cRequestPacket &req) /* OPCODE 21 */
 {
   if (m_isStreaming)
-    StopChannelStreaming();
+    StopChannelStreaming(true);
 
   cResponsePacket resp;
   resp.init(req.getRequestID());
@@ -853,6 +907,74 @@ bool cVNSIClient::processChannelStream_Seek(cRequestPacket &req) /* OPCODE 22 */
   return true;
 }
 
+bool cVNSIClient::processChannelStream_Export(cRequestPacket &req) /* OPCODE 23 */
+{
+  cResponsePacket resp;
+  resp.init(req.getRequestID());
+
+  if (m_isStreaming && m_Streamer)
+  {
+    time_t start = req.extract_U32();
+    time_t end = req.extract_U32();
+    const char *name = req.extract_String();
+    if (m_Streamer->Export(start, end, name))
+      resp.add_U32(VNSI_RET_OK);
+    else
+      resp.add_U32(VNSI_RET_ERROR);
+  }
+  else
+    resp.add_U32(VNSI_RET_ERROR);
+
+  resp.finalise();
+  m_socket.write(resp.getPtr(), resp.getLen());
+  return true;
+}
+
+bool cVNSIClient::processChannelStream_Pause(cRequestPacket &req) /* OPCODE 24 */
+{
+  cResponsePacket resp;
+  resp.init(req.getRequestID());
+
+  if (m_isStreaming && m_Streamer)
+  {
+    uint32_t pause = req.extract_U32();
+    if (!pause || m_Streamer->Promote())
+      resp.add_U32(VNSI_RET_OK);
+    else
+      resp.add_U32(VNSI_RET_ERROR);
+  }
+  else
+    resp.add_U32(VNSI_RET_ERROR);
+
+  resp.finalise();
+  m_socket.write(resp.getPtr(), resp.getLen());
+  return true;
+}
+
+bool cVNSIClient::processChannelStream_Resume(cRequestPacket &req) /* OPCODE 25 */
+{
+  uint32_t token = req.extract_U32();
+  int64_t time = req.extract_S64();
+
+  StopChannelStreaming(m_isStreaming);
+
+  cResponsePacket resp;
+  resp.init(req.getRequestID());
+
+  // the stream kept for this client answers itself, ahead of its packets
+  m_Streamer = cLiveStreamer::ResumeSession(token, time, NewToken(), &m_socket, &resp);
+  if (m_Streamer)
+  {
+    m_isStreaming = true;
+    return true;
+  }
+
+  resp.add_U32(VNSI_RET_DATAINVALID);
+  resp.finalise();
+  m_socket.write(resp.getPtr(), resp.getLen());
+  return true;
+}
+
 /** OPCODE 40 - 59: VNSI network functions for recording streaming */
 
 bool cVNSIClient::processRecStream_Open(cRequestPacket &req) /* OPCODE 40 */
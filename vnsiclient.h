@@ -106,7 +106,8 @@ protected:
   void SetLoggedIn(bool yesNo) { m_loggedIn = yesNo; }
   void SetStatusInterface(bool yesNo) { m_StatusInterfaceEnabled = yesNo; }
   bool StartChannelStreaming(cResponsePacket &resp, const cChannel *channel, int32_t priority, uint8_t timeshift, uint32_t timeout);
-  void StopChannelStreaming();
+  void StopChannelStreaming(bool park = false, bool session = false);
+  uint32_t NewToken();
 
 private:
 
@@ -128,6 +129,9 @@ private:
   bool processChannelStream_Open(cRequestPacket &r);
   bool processChannelStream_Close(cRequestPacket &req);
   bool processChannelStream_Seek(cRequestPacket &r);
+  bool processChannelStream_Export(cRequestPacket &r);
+  bool processChannelStream_Pause(cRequestPacket &r);
+  bool processChannelStream_Resume(cRequestPacket &r);
 
   bool processRecStream_Open(cRequestPacket &r);
   bool processRecStream_Close(cRequestPacket &r);
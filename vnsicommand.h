@@ -27,11 +27,14 @@
 #define VNSI_COMMAND_H
 
 /** Current VNSI Protocol Version number */
-#define VNSI_PROTOCOLVERSION 9
+#define VNSI_PROTOCOLVERSION 12
 
 /** Start of RDS support protocol Version */
 #define VNSI_RDS_PROTOCOLVERSION 8
 
+/** Start of stream resume support protocol Version */
+#define VNSI_RESUME_PROTOCOLVERSION 12
+
 /** Minimum VNSI Protocol Version number */
 #define VNSI_MIN_PROTOCOLVERSION 5
 
@@ -50,10 +53,21 @@
 #define CONFNAME_TIMESHIFT "Timeshift"
 #define CONFNAME_TIMESHIFTBUFFERSIZE "TimeshiftBufferSize"
 #define CONFNAME_TIMESHIFTBUFFERFILESIZE "TimeshiftBufferFileSize"
+#define CONFNAME_TIMESHIFTMEMORYBUDGET "TimeshiftMemoryBudget"
+#define CONFNAME_TIMESHIFTSHARED "TimeshiftShared"
 #define CONFNAME_TIMESHIFTBUFFERDIR "TimeshiftBufferDir"
+#define CONFNAME_TIMESHIFTBUFFERDIRECTIO "TimeshiftBufferDirectIO"
+#define CONFNAME_TIMESHIFTRAMSECONDS "TimeshiftRAMSeconds"
 #define CONFNAME_PLAYRECORDING "PlayRecording"
 #define CONFNAME_AVOIDEPGSCAN "AvoidEPGScan"
 #define CONFNAME_DISABLESCRAMBLETIMEOUT "DisableScrambleTimeout"
+#define CONFNAME_BACKZAPCHANNELS "BackZapChannels"
+#define CONFNAME_BACKZAPGRACETIME "BackZapGraceTime"
+#define CONFNAME_PACINGLEAD "PacingLead"
+#define CONFNAME_LIVEBUFFERSECONDS "LiveBufferSeconds"
+#define CONFNAME_TIMESHIFTONDEMAND "TimeshiftOnDemand"
+#define CONFNAME_RESUMEGRACETIME "ResumeGraceTime"
+#define CONFNAME_PESBUFFERMAXSIZE "PesBufferMaxSize"
 
 /* OPCODE 1 - 19: VNSI network functions for general purpose */
 #define VNSI_LOGIN                 1
@@ -67,6 +81,9 @@
 #define VNSI_CHANNELSTREAM_OPEN     20
 #define VNSI_CHANNELSTREAM_CLOSE    21
 #define VNSI_CHANNELSTREAM_SEEK     22
+#define VNSI_CHANNELSTREAM_EXPORT   23
+#define VNSI_CHANNELSTREAM_PAUSE    24
+#define VNSI_CHANNELSTREAM_RESUME   25
 
 /* OPCODE 40 - 59: VNSI network functions for recording streaming */
 #define VNSI_RECSTREAM_OPEN        40
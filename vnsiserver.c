@@ -25,6 +25,7 @@
 
 #include "vnsiserver.h"
 #include "vnsiclient.h"
+#include "streamer.h"
 #include "vnsi.h"
 #include "channelfilter.h"
 
@@ -84,6 +85,7 @@ cVNSIServer::~cVNSIServer()
 {
   Cancel();
   m_Status.Shutdown();
+  cLiveStreamer::ClearParked();
   m_timers.Shutdown();
   INFOLOG("VNSI Server stopped");
 }